@@ -0,0 +1,200 @@
+// ********************************************************************************
+// Host benchmark of the filtering, decoding and rule modules.
+//
+// Runs pulse traces, synthetic ones or the recorded ones named on the
+// command line, through the same filter, decoder and rules as the
+// firmware and reports for each trace:
+//
+// * ns/frame: host time spent per frame from filter to led levels.
+// * latency: frames from a change of the expected state until the
+//   decoded state matches it, mean and worst.
+// * first: frames from boot until the filter first holds a width
+//   within the range, the first valid decode.
+// * unconverged: expected state changes that were never decoded.
+// * misdecode: fraction of frames decoded to a state that is neither
+//   the expected one nor, while converging, the previous one.
+// ********************************************************************************
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime() and CLOCK_MONOTONIC under a strict -std=c11
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "bench.h"
+#include "input_filter.h"
+#include "master_state.h"
+#include "light_rules.h"
+
+#define BENCH_MIN_TIMED_FRAMES 2000000
+
+struct BenchResult {
+  double ns_per_frame;
+  size_t first_valid_frames;
+  size_t changes;
+  size_t latency_frames_sum;
+  size_t latency_frames_max;
+  size_t unconverged;
+  size_t misdecodes;
+};
+
+static volatile uint16_t bench_sink; // keeps the compiler from dropping the rules
+static bool bench_valid;            // whether the last frame decoded from a width within the range
+
+static hi_us_t bench_hi_us(double us) {
+#if INPUT_PWM_FLOAT
+  return us;
+#else
+  return (hi_us_t)lround(us * (1 << HI_US_FRAC_BITS));
+#endif
+}
+
+static uint8_t bench_frame(hi_us_t hi_us) {
+  uint16_t levels[LED_COUNT];
+
+  bench_input_push(hi_us);
+
+  hi_us_t filtered_hi_us = filter_input_pwm_hi_us();
+  bench_valid = input_pwm_hi_us_in_range(filtered_hi_us);
+  uint8_t state = input_pwm_hi_us_to_master_lights_state(filtered_hi_us);
+
+  apply_master_lights_state(state, 0xff, levels);
+  bench_sink = levels[0];
+
+  return state;
+}
+
+static double now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_score(const struct Trace* trace, const uint8_t* decoded, struct BenchResult* result) {
+  int previous = MASTER_LIGHTS_OFF_STATE; // what the filters decode right after boot
+  size_t start = 0;
+
+  while (start < trace->count) {
+    const int expected = trace->frames[start].expected_state;
+    size_t end = start;
+
+    while (end < trace->count && trace->frames[end].expected_state == expected) {
+      end++;
+    }
+
+    if (expected != NO_EXPECTED_STATE) {
+      bool converged = false;
+
+      for (size_t i = start; i < end; i++) {
+        if (!converged && decoded[i] == expected) {
+          converged = true;
+          result->latency_frames_sum += i - start + 1;
+
+          if (i - start + 1 > result->latency_frames_max) {
+            result->latency_frames_max = i - start + 1;
+          }
+        } else if (decoded[i] != expected && (converged || decoded[i] != previous)) {
+          result->misdecodes++;
+        }
+      }
+
+      result->changes++;
+      result->unconverged += !converged;
+      previous = expected;
+    }
+
+    start = end;
+  }
+}
+
+static void bench_run(const struct Trace* trace) {
+  struct BenchResult result = { 0 };
+  hi_us_t* widths = malloc(trace->count * sizeof(hi_us_t));
+  uint8_t* decoded = malloc(trace->count);
+
+  for (size_t i = 0; i < trace->count; i++) {
+    widths[i] = bench_hi_us(trace->frames[i].hi_us);
+  }
+
+  reset_input_filters();
+  result.first_valid_frames = trace->count;
+
+  for (size_t i = 0; i < trace->count; i++) {
+    decoded[i] = bench_frame(widths[i]);
+
+    if (bench_valid && result.first_valid_frames == trace->count) {
+      result.first_valid_frames = i + 1;
+    }
+  }
+
+  bench_score(trace, decoded, &result);
+
+  size_t reps = trace->count ? (BENCH_MIN_TIMED_FRAMES + trace->count - 1) / trace->count : 0;
+  double start_ns = now_ns();
+
+  for (size_t rep = 0; rep < reps; rep++) {
+    reset_input_filters();
+
+    for (size_t i = 0; i < trace->count; i++) {
+      bench_frame(widths[i]);
+    }
+  }
+
+  result.ns_per_frame = reps ? (now_ns() - start_ns) / (reps * trace->count) : 0;
+
+  const size_t scored_changes = result.changes - result.unconverged;
+
+  printf("%-24s %8zu %9.1f %6zu %9.2f %6zu %11zu %9.4f\n",
+         trace->name, trace->count, result.ns_per_frame, result.first_valid_frames,
+         scored_changes ? (double)result.latency_frames_sum / scored_changes : 0.0,
+         result.latency_frames_max, result.unconverged,
+         trace->count ? (double)result.misdecodes / trace->count : 0.0);
+
+  free(widths);
+  free(decoded);
+}
+
+int main(int argc, char** argv) {
+  printf("%-24s %8s %9s %6s %9s %6s %11s %9s\n",
+         "trace", "frames", "ns/frame", "first", "latency", "worst", "unconverged", "misdecode");
+
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      struct Trace trace = { .name = argv[i] };
+
+      if (!trace_load(&trace, argv[i])) {
+        fprintf(stderr, "cannot read %s\n", argv[i]);
+        return 1;
+      }
+
+      bench_run(&trace);
+      trace_free(&trace);
+    }
+
+    return 0;
+  }
+
+  struct Trace clean = { .name = "sweep clean" };
+  struct Trace jitter = { .name = "sweep jitter 2us" };
+  struct Trace spikes = { .name = "sweep jitter 2us spikes" };
+  struct Trace boundaries = { .name = "bucket boundaries" };
+
+  trace_synth_sweep(&clean, 0, 0);
+  trace_synth_sweep(&jitter, 2, 0);
+  trace_synth_sweep(&spikes, 2, 25);
+  trace_synth_boundaries(&boundaries);
+
+  bench_run(&clean);
+  bench_run(&jitter);
+  bench_run(&spikes);
+  bench_run(&boundaries);
+
+  trace_free(&clean);
+  trace_free(&jitter);
+  trace_free(&spikes);
+  trace_free(&boundaries);
+
+  return 0;
+}
@@ -0,0 +1,39 @@
+// ********************************************************************************
+// Host benchmark of the filtering, decoding and rule modules.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_BENCH_H
+#define RCLIGHTS_BENCH_H
+
+#include <stddef.h>
+#include "input_pwm.h"
+
+#define NO_EXPECTED_STATE -1
+
+struct TraceFrame {
+  double hi_us;       // pulse width in microseconds
+  int expected_state; // master lights state the frame should decode to, or NO_EXPECTED_STATE
+};
+
+struct Trace {
+  const char* name;
+  struct TraceFrame* frames;
+  size_t count;
+  size_t capacity;
+};
+
+void trace_add(struct Trace* trace, double hi_us, int expected_state);
+void trace_free(struct Trace* trace);
+
+/* Synthetic traces, see trace_synth.c. */
+void trace_synth_sweep(struct Trace* trace, double jitter_us, unsigned spike_every);
+void trace_synth_boundaries(struct Trace* trace);
+
+/* Reads a recorded trace, see trace_file.c.  Returns false when the
+   file cannot be read. */
+bool trace_load(struct Trace* trace, const char* path);
+
+/* Makes the next input value available to the filters. */
+void bench_input_push(hi_us_t hi_us);
+
+#endif
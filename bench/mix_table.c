@@ -0,0 +1,42 @@
+// ********************************************************************************
+// Prints the transmitter mix table of the master state layout the
+// decoder is built with, as a markdown table: for every state id, the
+// width a transmitter should send, the widths that decode to it and
+// the light functions it turns on.
+// ********************************************************************************
+
+#include <stdio.h>
+#include "master_state.h"
+#include "light_rules.h"
+
+static const char* mark(uint8_t state, uint8_t bit) {
+  return state & bit ? "x" : "";
+}
+
+int main() {
+  printf("| id | send µs | decodes µs | brake | reverse | left | right | hi beams | lights |\n");
+  printf("|---:|---:|---:|:---:|:---:|:---:|:---:|:---:|:---:|\n");
+
+  for (int state_id = 0; state_id < MASTER_LIGHT_STATE_COUNT; state_id++) {
+    const uint8_t state = MASTER_LIGHTS_STATE_OF_ID(state_id);
+    int first_us = 0;
+    int last_us = 0;
+
+    for (int us = INPUT_PWM_US_RANGE_MIN; us <= INPUT_PWM_US_RANGE_MAX; us++) {
+      if (input_pwm_hi_us_to_master_state_id(HI_US(us)) == state_id) {
+        first_us = first_us ? first_us : us;
+        last_us = us;
+      }
+    }
+
+    const int centre_us = (first_us + last_us + 1) / 2;
+
+    printf("| %d | %d | %d–%d | %s | %s | %s | %s | %s | %s |\n",
+           state_id, centre_us, first_us, last_us,
+           mark(state, BRAKE_LIGHT_BIT), mark(state, REVERSE_LIGHT_BIT),
+           mark(state, LEFT_BLINK_BIT), mark(state, RIGHT_BLINK_BIT),
+           mark(state, HI_BEAMS_BIT), mark(state, DAY_NIGHT_BIT));
+  }
+
+  return 0;
+}
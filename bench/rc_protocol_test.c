@@ -0,0 +1,397 @@
+// ********************************************************************************
+// Host test of the serial RC receiver protocol parsers.
+//
+// Feeds SBUS, iBUS and CRSF byte streams built here, byte by byte as
+// the firmware does, through the parsers of rclights/rc_protocol.c
+// and checks the frames they report: valid frames decode to the
+// expected widths, corrupt frames are rejected, and a valid frame is
+// still found after garbage, after a corrupt frame and when it
+// starts inside one.  Prints each check that fails and exits with a
+// non-zero status if any did.
+// ********************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include "rc_protocol.h"
+
+#define TEST_STREAM_SIZE 256
+#define TEST_MAX_FRAMES 4
+
+static int test_failures = 0;
+
+#define TEST_CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+      test_failures++; \
+    } \
+  } while (0)
+
+/* 11 bit channel values of SBUS and CRSF and the widths they decode
+   to: -100%, centre, +100% and a value in between. */
+static const uint16_t TEST_11BIT_VALUES[] = { 172, 992, 1811, 1200 };
+static const uint16_t TEST_11BIT_US[] = { 988, 1500, 2011, 1630 };
+
+#define TEST_11BIT_VALUE_COUNT (sizeof(TEST_11BIT_VALUES) / sizeof(TEST_11BIT_VALUES[0]))
+
+/* iBUS widths, one per channel. */
+static const uint16_t TEST_IBUS_US[] = { 1000, 1100, 1200, 1300, 1400, 1500, 1600, 1700, 1800, 1900, 2000, 988, 1500, 2012 };
+
+#define TEST_IBUS_CHANNEL_COUNT (sizeof(TEST_IBUS_US) / sizeof(TEST_IBUS_US[0]))
+
+typedef bool (*TestParseByte)(struct RcParser* parser, uint8_t byte, struct RcFrame* frame);
+
+struct TestStream {
+  uint8_t bytes[TEST_STREAM_SIZE];
+  size_t length;
+};
+
+static void test_append(struct TestStream* stream, const uint8_t* bytes, size_t length) {
+  memcpy(stream->bytes + stream->length, bytes, length);
+  stream->length += length;
+}
+
+/* The following function feeds stream to a fresh parser and returns
+   the count of frames it reported.  The last of them is left in
+   frame, and the index of the byte that completed each one in
+   frame_ends.  The parser buffer must never fill up. */
+static int test_parse(TestParseByte parse_byte, const struct TestStream* stream, struct RcFrame* frame,
+                      size_t* frame_ends) {
+  struct RcParser parser = { .length = 0 };
+  int frames = 0;
+
+  memset(frame, 0, sizeof(*frame));
+
+  for (size_t i = 0; i < stream->length; i++) {
+    if (parse_byte(&parser, stream->bytes[i], frame) && frames++ < TEST_MAX_FRAMES) {
+      frame_ends[frames - 1] = i;
+    }
+
+    TEST_CHECK(parser.length < RC_PARSER_BUFFER_SIZE);
+  }
+
+  return frames;
+}
+
+/* The following function packs the test values into 16 channels of
+   11 bits, least significant bit first, channel i taking value
+   i modulo TEST_11BIT_VALUE_COUNT. */
+static void test_pack_11bit_channels(uint8_t* data) {
+  uint32_t bits = 0;
+  uint8_t bit_count = 0;
+
+  for (int ch = 0; ch < RC_CHANNEL_COUNT; ch++) {
+    bits |= (uint32_t)TEST_11BIT_VALUES[ch % TEST_11BIT_VALUE_COUNT] << bit_count;
+    bit_count += 11;
+
+    while (bit_count >= 8) {
+      *data++ = bits & 0xff;
+      bits >>= 8;
+      bit_count -= 8;
+    }
+  }
+}
+
+static void test_check_11bit_channels(const struct RcFrame* frame) {
+  TEST_CHECK(frame->channel_count == RC_CHANNEL_COUNT);
+
+  for (int ch = 0; ch < RC_CHANNEL_COUNT; ch++) {
+    TEST_CHECK(frame->us[ch] == TEST_11BIT_US[ch % TEST_11BIT_VALUE_COUNT]);
+  }
+}
+
+// ********************************************************************************
+// SBUS
+
+static void test_sbus_frame(uint8_t* frame, uint8_t flags, uint8_t footer) {
+  frame[0] = 0x0f;
+  test_pack_11bit_channels(&frame[1]);
+  frame[23] = flags;
+  frame[24] = footer;
+}
+
+static void test_sbus() {
+  uint8_t valid[25], failsafe[25], sbus2[25], bad_footer[25];
+  struct TestStream stream;
+  struct RcFrame frame;
+  size_t ends[TEST_MAX_FRAMES];
+
+  test_sbus_frame(valid, 0x00, 0x00);
+  test_sbus_frame(failsafe, 0x08, 0x00);
+  test_sbus_frame(sbus2, 0x00, 0x14);
+  test_sbus_frame(bad_footer, 0x00, 0x55);
+
+  stream.length = 0;
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(sbus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+  TEST_CHECK(!frame.failsafe);
+
+  stream.length = 0;
+  test_append(&stream, failsafe, sizeof(failsafe));
+  TEST_CHECK(test_parse(sbus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(frame.failsafe);
+
+  stream.length = 0;
+  test_append(&stream, sbus2, sizeof(sbus2));
+  TEST_CHECK(test_parse(sbus_parse_byte, &stream, &frame, ends) == 1);
+  test_check_11bit_channels(&frame);
+
+  /* A bad footer rejects the frame but not the one after it. */
+  stream.length = 0;
+  test_append(&stream, bad_footer, sizeof(bad_footer));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(sbus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(bad_footer) + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+
+  /* Garbage before the first header is skipped. */
+  const uint8_t garbage[] = { 0x00, 0xff, 0x55, 0xaa };
+
+  stream.length = 0;
+  test_append(&stream, garbage, sizeof(garbage));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(sbus_parse_byte, &stream, &frame, ends) == 1);
+  test_check_11bit_channels(&frame);
+
+  /* A frame that starts inside a truncated one is still found once the
+     truncated one fails its footer. */
+  stream.length = 0;
+  test_append(&stream, valid, 10);
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(sbus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == 10 + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+}
+
+// ********************************************************************************
+// iBUS
+
+static void test_ibus_frame(uint8_t* frame) {
+  uint16_t checksum = 0xffff;
+
+  frame[0] = 0x20;
+  frame[1] = 0x40;
+
+  for (int ch = 0; ch < TEST_IBUS_CHANNEL_COUNT; ch++) {
+    frame[2 + 2 * ch] = TEST_IBUS_US[ch] & 0xff;
+    frame[3 + 2 * ch] = TEST_IBUS_US[ch] >> 8;
+  }
+
+  for (int i = 0; i < 30; i++) {
+    checksum -= frame[i];
+  }
+
+  frame[30] = checksum & 0xff;
+  frame[31] = checksum >> 8;
+}
+
+static void test_check_ibus_channels(const struct RcFrame* frame) {
+  TEST_CHECK(frame->channel_count == TEST_IBUS_CHANNEL_COUNT);
+
+  for (int ch = 0; ch < TEST_IBUS_CHANNEL_COUNT; ch++) {
+    TEST_CHECK(frame->us[ch] == TEST_IBUS_US[ch]);
+  }
+
+  for (int ch = TEST_IBUS_CHANNEL_COUNT; ch < RC_CHANNEL_COUNT; ch++) {
+    TEST_CHECK(frame->us[ch] == 0);
+  }
+}
+
+static void test_ibus() {
+  uint8_t valid[32], bad_checksum[32];
+  struct TestStream stream;
+  struct RcFrame frame;
+  size_t ends[TEST_MAX_FRAMES];
+
+  test_ibus_frame(valid);
+  test_ibus_frame(bad_checksum);
+  bad_checksum[4] ^= 0x01;
+
+  stream.length = 0;
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(ibus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(valid) - 1);
+  test_check_ibus_channels(&frame);
+  TEST_CHECK(!frame.failsafe);
+
+  /* A bad checksum rejects the frame but not the one after it. */
+  stream.length = 0;
+  test_append(&stream, bad_checksum, sizeof(bad_checksum));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(ibus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(bad_checksum) + sizeof(valid) - 1);
+  test_check_ibus_channels(&frame);
+
+  /* A first header byte without the second one is not a frame. */
+  const uint8_t garbage[] = { 0x20, 0x20, 0x41, 0x00, 0x20 };
+
+  stream.length = 0;
+  test_append(&stream, garbage, sizeof(garbage));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(ibus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(garbage) + sizeof(valid) - 1);
+  test_check_ibus_channels(&frame);
+
+  /* A bad frame with a first header byte inside it: the resync after
+     its checksum lands there, and the missing second header byte
+     rejects it right away. */
+  uint8_t bad_inside[32] = { 0x20, 0x40, 0x20, 0x41 };
+
+  stream.length = 0;
+  test_append(&stream, bad_inside, sizeof(bad_inside));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(ibus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(bad_inside) + sizeof(valid) - 1);
+  test_check_ibus_channels(&frame);
+
+  /* A frame that starts inside a truncated one is still found once the
+     truncated one fails its checksum. */
+  stream.length = 0;
+  test_append(&stream, valid, 12);
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(ibus_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == 12 + sizeof(valid) - 1);
+  test_check_ibus_channels(&frame);
+}
+
+// ********************************************************************************
+// CRSF
+
+/* Same CRC-8 as the parser, polynomial 0xd5, written bytewise rather
+   than bitwise so the test does not just repeat it. */
+static uint8_t test_crsf_crc8(const uint8_t* data, size_t length) {
+  static uint8_t table[256];
+  static bool table_ready = false;
+
+  if (!table_ready) {
+    for (int i = 0; i < 256; i++) {
+      uint8_t crc = i;
+
+      for (int bit = 0; bit < 8; bit++) {
+        crc = crc & 0x80 ? (crc << 1) ^ 0xd5 : crc << 1;
+      }
+
+      table[i] = crc;
+    }
+
+    table_ready = true;
+  }
+
+  uint8_t crc = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    crc = table[crc ^ data[i]];
+  }
+
+  return crc;
+}
+
+/* The following function builds a frame of type with payload and
+   returns its size. */
+static size_t test_crsf_frame(uint8_t* frame, uint8_t address, uint8_t type, const uint8_t* payload,
+                              size_t payload_size) {
+  frame[0] = address;
+  frame[1] = payload_size + 2;
+  frame[2] = type;
+  memcpy(&frame[3], payload, payload_size);
+  frame[3 + payload_size] = test_crsf_crc8(&frame[2], payload_size + 1);
+
+  return payload_size + 4;
+}
+
+#define TEST_CRSF_BAD_INSIDE_SIZE 206 // a bad frame of 26 bytes and 180 more, far more than the parser buffer
+
+static void test_crsf() {
+  uint8_t channels[22], link_stats[10] = { 0x50, 0x50, 0x64, 0x0a };
+  uint8_t valid[26], from_transmitter[26], bad_crc[26], other[14];
+  struct TestStream stream;
+  struct RcFrame frame;
+  size_t ends[TEST_MAX_FRAMES];
+
+  test_pack_11bit_channels(channels);
+
+  const size_t valid_size = test_crsf_frame(valid, 0xc8, 0x16, channels, sizeof(channels));
+  test_crsf_frame(from_transmitter, 0xee, 0x16, channels, sizeof(channels));
+  test_crsf_frame(bad_crc, 0xc8, 0x16, channels, sizeof(channels));
+  bad_crc[7] ^= 0x10;
+  const size_t other_size = test_crsf_frame(other, 0xc8, 0x14, link_stats, sizeof(link_stats));
+
+  TEST_CHECK(valid_size == sizeof(valid));
+  TEST_CHECK(other_size == sizeof(other));
+
+  stream.length = 0;
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+  TEST_CHECK(!frame.failsafe);
+
+  stream.length = 0;
+  test_append(&stream, from_transmitter, sizeof(from_transmitter));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  test_check_11bit_channels(&frame);
+
+  /* Frames of other types are skipped whole. */
+  stream.length = 0;
+  test_append(&stream, other, sizeof(other));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(other) + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+
+  /* A bad CRC rejects the frame but not the one after it. */
+  stream.length = 0;
+  test_append(&stream, bad_crc, sizeof(bad_crc));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(bad_crc) + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+
+  /* An address byte followed by an impossible length is not a frame. */
+  const uint8_t garbage[] = { 0x00, 0xc8, 0x01, 0xc8, 0xff, 0x55 };
+
+  stream.length = 0;
+  test_append(&stream, garbage, sizeof(garbage));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(garbage) + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+
+  /* A bad frame with an address byte and an impossible length inside
+     it: the resync after its CRC lands there, and the length rejects
+     it right away rather than letting it run past the buffer. */
+  uint8_t bad_inside[TEST_CRSF_BAD_INSIDE_SIZE] = { 0xc8, 0x18, 0x16, 0x01, 0xc8, 0xff };
+
+  memset(bad_inside + 6, 0x55, sizeof(bad_inside) - 6);
+  stream.length = 0;
+  test_append(&stream, bad_inside, sizeof(bad_inside));
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == sizeof(bad_inside) + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+
+  /* A frame that starts inside a truncated one is still found once the
+     truncated one fails its CRC. */
+  stream.length = 0;
+  test_append(&stream, valid, 9);
+  test_append(&stream, valid, sizeof(valid));
+  TEST_CHECK(test_parse(crsf_parse_byte, &stream, &frame, ends) == 1);
+  TEST_CHECK(ends[0] == 9 + sizeof(valid) - 1);
+  test_check_11bit_channels(&frame);
+}
+
+int main() {
+  test_sbus();
+  test_ibus();
+  test_crsf();
+
+  if (test_failures) {
+    printf("%d checks failed\n", test_failures);
+    return 1;
+  }
+
+  printf("all checks passed\n");
+  return 0;
+}
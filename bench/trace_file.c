@@ -0,0 +1,78 @@
+// ********************************************************************************
+// Recorded pulse traces.
+//
+// A trace file holds one frame per line: the pulse width in
+// microseconds, optionally followed by the master lights state the
+// frame should decode to.  Further columns, such as the times in a
+// trace dumped by the firmware, empty lines and lines starting with #
+// are ignored.
+//
+// A trace saved to flash by the firmware, read back from the board
+// as a binary file, loads too, see rclights/trace_record.h.  Either
+// way the states of a recorded trace are what the firmware decoded,
+// so a replay through the same filter decodes each change within a
+// frame and other filters are scored against it.
+// ********************************************************************************
+
+#include <stdio.h>
+#include "bench.h"
+#include "trace_record.h"
+
+/* The following function loads the records after the header of a
+   saved trace.  Records past the end of a truncated file are
+   dropped. */
+static void trace_load_records(struct Trace* trace, FILE* file, uint32_t count) {
+  uint32_t record;
+
+  while (count-- > 0 && fread(&record, sizeof(record), 1, file) == 1) {
+    trace_add(trace, TRACE_RECORD_HI_16THS(record) / 16.0, TRACE_RECORD_STATE(record));
+  }
+}
+
+bool trace_load(struct Trace* trace, const char* path) {
+  FILE* file = fopen(path, "rb");
+
+  if (!file) {
+    return false;
+  }
+
+  struct TraceRecordHeader header;
+
+  if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == TRACE_RECORD_MAGIC) {
+    if (header.check == trace_record_check(&header)) {
+      trace_load_records(trace, file, header.count);
+    }
+
+    fclose(file);
+
+    return true;
+  }
+
+  rewind(file);
+
+  char line[128];
+
+  while (fgets(line, sizeof(line), file)) {
+    double hi_us;
+    int expected_state;
+
+    if (line[0] == '#') {
+      continue;
+    }
+
+    switch (sscanf(line, "%lf %d", &hi_us, &expected_state)) {
+    case 2:
+      trace_add(trace, hi_us, expected_state);
+      break;
+    case 1:
+      trace_add(trace, hi_us, NO_EXPECTED_STATE);
+      break;
+    default:
+      break;
+    }
+  }
+
+  fclose(file);
+
+  return true;
+}
@@ -0,0 +1,32 @@
+// ********************************************************************************
+// Host implementation of the input layer of input_pwm.h.
+//
+// The benchmark pushes one pulse width per frame and the filters read
+// it back exactly once, as they would read a new pulse on the device.
+// ********************************************************************************
+
+#include "bench.h"
+
+volatile uint32_t input_frame_count = 0;
+hi_us_t input_frame_hi_us = 0;
+
+static hi_us_t pending_hi_us = 0;
+static bool pending = false;
+
+void bench_input_push(hi_us_t hi_us) {
+  pending_hi_us = hi_us;
+  pending = true;
+}
+
+bool input_pwm_hi_us_ready() {
+  return pending;
+}
+
+hi_us_t next_input_pwm_hi_us() {
+  pending = false;
+
+  input_frame_hi_us = pending_hi_us;
+  input_frame_count++;
+
+  return pending_hi_us;
+}
@@ -0,0 +1,88 @@
+// ********************************************************************************
+// Synthetic pulse traces.
+// ********************************************************************************
+
+#include <math.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "master_state.h"
+
+#define SYNTH_HOLD_FRAMES 40 // frames spent on each state, a bit over half a second
+
+static const double SYNTH_PI = 3.14159265358979323846; // M_PI is POSIX, not C11
+
+static const double BUCKET_US = (double)INPUT_PWM_US_RANGE_SIZE / (MASTER_LIGHT_STATE_COUNT - 1);
+
+/* Deterministic generator so that runs are comparable. */
+static uint32_t synth_random_state = 1;
+
+static double synth_uniform() {
+  synth_random_state = synth_random_state * 1664525 + 1013904223;
+  return ((synth_random_state >> 8) + 0.5) / (double)(1 << 24);
+}
+
+static double synth_gaussian() {
+  return sqrt(-2 * log(synth_uniform())) * cos(2 * SYNTH_PI * synth_uniform());
+}
+
+/* Bucket centres as the decoder sees them; the last one lies just
+   past the range, so it is held at the range end. */
+static double state_id_centre_us(int state_id) {
+  return fmin(INPUT_PWM_US_RANGE_MIN + state_id * BUCKET_US, INPUT_PWM_US_RANGE_MAX);
+}
+
+void trace_add(struct Trace* trace, double hi_us, int expected_state) {
+  if (trace->count == trace->capacity) {
+    trace->capacity = trace->capacity ? trace->capacity * 2 : 1024;
+    trace->frames = realloc(trace->frames, trace->capacity * sizeof(struct TraceFrame));
+  }
+
+  trace->frames[trace->count].hi_us = hi_us;
+  trace->frames[trace->count].expected_state = expected_state;
+  trace->count++;
+}
+
+void trace_free(struct Trace* trace) {
+  free(trace->frames);
+  trace->frames = NULL;
+  trace->count = trace->capacity = 0;
+}
+
+/* Visits every state id at its centre width in a zig-zag order, so
+   both short and long jumps appear.  Every width gets gaussian jitter
+   and, when spike_every is not 0, every spike_every-th frame is
+   replaced by a random width within the range.  Receivers report
+   whole microseconds, so widths are rounded. */
+void trace_synth_sweep(struct Trace* trace, double jitter_us, unsigned spike_every) {
+  synth_random_state = 1;
+
+  for (int i = 0; i < MASTER_LIGHT_STATE_COUNT; i++) {
+    const int state_id = i % 2 ? MASTER_LIGHT_STATE_COUNT - 1 - i / 2 : i / 2;
+    const int expected = MASTER_LIGHTS_STATE_OF_ID(state_id);
+
+    for (int f = 0; f < SYNTH_HOLD_FRAMES; f++) {
+      double hi_us = state_id_centre_us(state_id) + jitter_us * synth_gaussian();
+
+      if (spike_every && (trace->count + 1) % spike_every == 0) {
+        hi_us = INPUT_PWM_US_RANGE_MIN + synth_uniform() * INPUT_PWM_US_RANGE_SIZE;
+      }
+
+      trace_add(trace, round(hi_us), expected);
+    }
+  }
+}
+
+/* Holds widths close to the upper boundary of every bucket, where
+   receiver jitter crosses into the next one. */
+void trace_synth_boundaries(struct Trace* trace) {
+  synth_random_state = 1;
+
+  for (int state_id = 0; state_id < MASTER_LIGHT_STATE_COUNT - 1; state_id++) {
+    const int expected = MASTER_LIGHTS_STATE_OF_ID(state_id);
+    const double near_edge_us = state_id_centre_us(state_id) + 0.4 * BUCKET_US;
+
+    for (int f = 0; f < SYNTH_HOLD_FRAMES; f++) {
+      trace_add(trace, round(near_edge_us + 1.0 * synth_gaussian()), expected);
+    }
+  }
+}
@@ -0,0 +1,138 @@
+// ********************************************************************************
+// Input range calibration
+// ********************************************************************************
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "hardware/regs/addressmap.h"
+#include "calibration.h"
+#include "input_capture.h"
+#include "master_state.h"
+#include "leds.h"
+
+#if RCLIGHTS_CALIBRATION
+
+/* The last sector of flash, far past the end of the program. */
+#define CALIBRATION_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+#define CALIBRATION_MAGIC 0x52434c31 // "RCL1"
+
+/* Widths outside of these are no servo pulse, whatever the radio. */
+#define CALIBRATION_PULSE_MIN_US 800
+#define CALIBRATION_PULSE_MAX_US 2200
+
+/* A width only counts when the one before it was this close, so a
+   single glitch cannot widen the range. */
+#define CALIBRATION_AGREE_US 3
+
+struct CalibrationRecord {
+  uint32_t magic;
+  uint16_t min_us;
+  uint16_t max_us;
+  uint32_t check; // guards against a record torn by a power cut
+};
+
+static uint32_t calibration_check(const struct CalibrationRecord* record) {
+  return ~(record->magic ^ record->min_us ^ ((uint32_t)record->max_us << 16));
+}
+
+static uint32_t calibration_us(hi_us_t hi_us) {
+#if INPUT_PWM_FLOAT
+  return hi_us + 0.5f;
+#else
+  return (hi_us + HI_US(1) / 2) >> HI_US_FRAC_BITS;
+#endif
+}
+
+/* Erasing and programming stall the flash, so nothing may run from
+   it meanwhile: core 1 is not running yet in calibration mode and
+   interrupts stay disabled. */
+static void write_calibration_record(const struct CalibrationRecord* record) {
+  uint8_t page[FLASH_PAGE_SIZE];
+
+  memset(page, 0xff, sizeof(page));
+  memcpy(page, record, sizeof(*record));
+
+  uint32_t interrupts = save_and_disable_interrupts();
+
+  flash_range_erase(CALIBRATION_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+  flash_range_program(CALIBRATION_FLASH_OFFSET, page, FLASH_PAGE_SIZE);
+
+  restore_interrupts(interrupts);
+}
+
+/* The following function records the narrowest and widest widths
+   while the calibration pin is shorted.  On success the brake lights
+   come on for a second before the reboot; a range that fails
+   input_pwm_us_range_valid() is not written and the board reboots
+   with the range it had. */
+static void run_input_pwm_calibration() {
+  init_pwm_measuring();
+  init_leds();
+  init_blink_groups();
+  render_master_lights_state(LEFT_BLINK_BIT | RIGHT_BLINK_BIT);
+
+  uint32_t min_us = UINT16_MAX;
+  uint32_t max_us = 0;
+  uint32_t previous_us = 0;
+
+  while (!gpio_get(CALIBRATION_PIN)) {
+    if (!input_pwm_hi_us_ready()) {
+      tight_loop_contents();
+      continue;
+    }
+
+    const uint32_t us = calibration_us(next_input_pwm_hi_us());
+
+    if (us >= CALIBRATION_PULSE_MIN_US && us <= CALIBRATION_PULSE_MAX_US
+        && us + CALIBRATION_AGREE_US >= previous_us && us <= previous_us + CALIBRATION_AGREE_US) {
+      min_us = us < min_us ? us : min_us;
+      max_us = us > max_us ? us : max_us;
+    }
+
+    previous_us = us;
+  }
+
+  if (max_us > min_us && input_pwm_us_range_valid(min_us, max_us, CALIBRATION_MIN_BUCKET_US)) {
+    struct CalibrationRecord record = {
+      .magic = CALIBRATION_MAGIC,
+      .min_us = min_us,
+      .max_us = max_us,
+    };
+
+    record.check = calibration_check(&record);
+    write_calibration_record(&record);
+
+    render_master_lights_state(BRAKE_LIGHT_BIT);
+    sleep_ms(1000);
+  }
+
+  watchdog_reboot(0, 0, 0);
+
+  while (true) {
+    tight_loop_contents();
+  }
+}
+
+void init_input_pwm_calibration() {
+  gpio_init(CALIBRATION_PIN);
+  gpio_set_dir(CALIBRATION_PIN, GPIO_IN);
+  gpio_pull_up(CALIBRATION_PIN);
+  sleep_us(10); // lets the pull-up charge the pin
+
+  if (!gpio_get(CALIBRATION_PIN)) {
+    run_input_pwm_calibration();
+  }
+
+  const struct CalibrationRecord* record = (const struct CalibrationRecord*)(XIP_BASE + CALIBRATION_FLASH_OFFSET);
+
+  if (record->magic == CALIBRATION_MAGIC && record->check == calibration_check(record)
+      && input_pwm_us_range_valid(record->min_us, record->max_us, CALIBRATION_MIN_BUCKET_US)) {
+    set_input_pwm_us_range(record->min_us, record->max_us);
+  }
+}
+
+#endif
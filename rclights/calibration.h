@@ -0,0 +1,47 @@
+// ********************************************************************************
+// Input range calibration
+//
+// With RCLIGHTS_CALIBRATION set to 1, the range of widths that the
+// buckets of the decoder span comes from flash instead of
+// INPUT_PWM_US_RANGE_MIN and INPUT_PWM_US_RANGE_MAX.  Booting with
+// CALIBRATION_PIN shorted to ground enters the calibration mode: the
+// hazards blink while the transmitter sweeps the mix from one end to
+// the other, and removing the short writes the endpoints seen to the
+// last sector of flash and reboots.  At every other boot, the range
+// is read back and the decoder lookup table regenerated for it, so a
+// new radio needs no new firmware and decoding costs the same per
+// frame.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_CALIBRATION_H
+#define RCLIGHTS_CALIBRATION_H
+
+#ifndef RCLIGHTS_CALIBRATION
+#define RCLIGHTS_CALIBRATION 0
+#endif
+
+#ifndef CALIBRATION_PIN
+#define CALIBRATION_PIN 3 // pulled up, short to ground to calibrate
+#endif
+
+/* Calibrated ranges narrower than this many microseconds per bucket
+   are rejected, as from a sweep that did not reach the ends. */
+#ifndef CALIBRATION_MIN_BUCKET_US
+#define CALIBRATION_MIN_BUCKET_US 8
+#endif
+
+#if RCLIGHTS_CALIBRATION
+
+/* Runs the calibration mode, which does not return, when the
+   calibration pin is shorted, and otherwise applies the calibrated
+   range, if flash holds one.  Called at boot before the capture is
+   initialised. */
+void init_input_pwm_calibration();
+
+#else
+
+static inline void init_input_pwm_calibration() {}
+
+#endif
+
+#endif
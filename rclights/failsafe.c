@@ -0,0 +1,105 @@
+// ********************************************************************************
+// Signal loss and failsafe
+// ********************************************************************************
+
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "failsafe.h"
+#include "input_capture.h"
+#include "telemetry.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_FAILSAFE
+
+/* The signal counts as lost when no frame arrived for the given
+   count of periods, plus half a period for the jitter of the
+   receiver.  A frame arrives when the capture counts one, whatever
+   its width: a serial or PPM frame too short to carry RC_MIX_CHANNEL
+   still shows the link is up.  The gate and wrap modes count every
+   window, with or without a pulse in it, so there a window of width 0
+   is no pulse and does not arrive. */
+static const uint32_t FAILSAFE_TIMEOUT_US = (2 * FAILSAFE_MISSED_FRAMES + 1) * INPUT_PWM_COUNTER_MAX / 2;
+
+volatile bool failsafe_signal_lost = false;
+
+static uint32_t failsafe_frame_count = 0;
+static uint32_t failsafe_frame_us = 0;
+
+/* Incremented by the decoding core on every pass, read by core 0 to
+   tell that core 1 still runs. */
+static volatile uint32_t failsafe_heartbeat = 0;
+static uint32_t failsafe_fed_heartbeat = 0;
+
+static repeating_timer_t failsafe_wake_timer;
+
+/* Taking the timer interrupt is what wakes a sleeping loop.  The
+   timer runs on the alarm pool of the calling core, see
+   input_alarm_pool(), so it interrupts the core that sleeps. */
+static bool RCLIGHTS_HOT_FUNC(failsafe_wake_timer_callback)(repeating_timer_t* timer) {
+  return true;
+}
+
+void init_failsafe() {
+  failsafe_frame_us = time_us_32();
+  alarm_pool_add_repeating_timer_us(input_alarm_pool(), INPUT_PWM_COUNTER_MAX, failsafe_wake_timer_callback, NULL,
+                                    &failsafe_wake_timer);
+}
+
+static inline bool failsafe_frame_arrived() {
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_GATE || INPUT_CAPTURE_MODE == INPUT_CAPTURE_WRAP
+  return input_frame_hi_us > HI_US(0);
+#else
+  return true;
+#endif
+}
+
+uint8_t RCLIGHTS_HOT_FUNC(failsafe_master_lights_state)(uint8_t state) {
+  const uint32_t now_us = time_us_32();
+
+  failsafe_heartbeat++;
+
+  if (input_frame_count != failsafe_frame_count) {
+    failsafe_frame_count = input_frame_count;
+
+    if (failsafe_frame_arrived()) {
+      failsafe_frame_us = now_us;
+
+      if (failsafe_signal_lost) {
+        failsafe_signal_lost = false;
+        telemetry_note_signal(false);
+      }
+    }
+  }
+
+  if (!failsafe_signal_lost && now_us - failsafe_frame_us > FAILSAFE_TIMEOUT_US) {
+    failsafe_signal_lost = true;
+    telemetry_note_signal(true);
+  }
+
+  return failsafe_signal_lost ? FAILSAFE_MASTER_LIGHTS_STATE : state;
+}
+
+void init_failsafe_watchdog() {
+  watchdog_enable(FAILSAFE_WATCHDOG_MS, true); // paused while a debugger halts the cores
+}
+
+/* watchdog_enable() reloads the counter, so either call also feeds
+   the watchdog. */
+void failsafe_stretch_watchdog(uint32_t ms) {
+  watchdog_enable(ms, true);
+}
+
+void failsafe_restore_watchdog() {
+  watchdog_enable(FAILSAFE_WATCHDOG_MS, true);
+}
+
+void RCLIGHTS_HOT_FUNC(failsafe_feed_watchdog)() {
+  const uint32_t heartbeat = failsafe_heartbeat;
+
+  if (heartbeat != failsafe_fed_heartbeat) {
+    failsafe_fed_heartbeat = heartbeat;
+    watchdog_update();
+  }
+}
+
+#endif
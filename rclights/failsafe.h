@@ -0,0 +1,76 @@
+// ********************************************************************************
+// Signal loss and failsafe
+//
+// With RCLIGHTS_FAILSAFE set to 1, a watchdog on pulse arrival
+// switches the lights to FAILSAFE_MASTER_LIGHTS_STATE once
+// FAILSAFE_MISSED_FRAMES input frames in a row have not arrived, and
+// back to the decoded state with the first frame that does.  A wake-up
+// timer at the input frame period runs the loop while no input
+// arrives, so the switch happens at most one period late.  The
+// hardware watchdog resets the board if the loop stops feeding it
+// for FAILSAFE_WATCHDOG_MS.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_FAILSAFE_H
+#define RCLIGHTS_FAILSAFE_H
+
+#include <stdint.h>
+#include "light_rules.h"
+
+#ifndef RCLIGHTS_FAILSAFE
+#define RCLIGHTS_FAILSAFE 0
+#endif
+
+#ifndef FAILSAFE_MISSED_FRAMES
+#define FAILSAFE_MISSED_FRAMES 3
+#endif
+
+/* Hazards and brake lights, so a stopped car without signal is seen. */
+#ifndef FAILSAFE_MASTER_LIGHTS_STATE
+#define FAILSAFE_MASTER_LIGHTS_STATE (LEFT_BLINK_BIT | RIGHT_BLINK_BIT | BRAKE_LIGHT_BIT)
+#endif
+
+#ifndef FAILSAFE_WATCHDOG_MS
+#define FAILSAFE_WATCHDOG_MS 250
+#endif
+
+#if RCLIGHTS_FAILSAFE
+
+/* True while the signal is lost. */
+extern volatile bool failsafe_signal_lost;
+
+/* Starts the wake-up timer on the core that calls it, which must be
+   the one that decodes the input. */
+void init_failsafe();
+
+/* Returns the decoded state, or the failsafe state while the signal
+   is lost.  Called by the decoding core on every pass of its loop. */
+uint8_t failsafe_master_lights_state(uint8_t state);
+
+/* Starts the hardware watchdog.  Called on core 0 once the lights are
+   initialised. */
+void init_failsafe_watchdog();
+
+/* Feeds the hardware watchdog.  Called on core 0 on every pass of its
+   loop; with RCLIGHTS_DUAL_CORE set to 1 it only feeds while the loop
+   of core 1 makes progress too. */
+void failsafe_feed_watchdog();
+
+/* Gives the hardware watchdog ms instead of FAILSAFE_WATCHDOG_MS,
+   for a flash write that keeps the loops busy longer than that, and
+   feeds it.  failsafe_restore_watchdog() goes back. */
+void failsafe_stretch_watchdog(uint32_t ms);
+void failsafe_restore_watchdog();
+
+#else
+
+static inline void init_failsafe() {}
+static inline uint8_t failsafe_master_lights_state(uint8_t state) { return state; }
+static inline void init_failsafe_watchdog() {}
+static inline void failsafe_feed_watchdog() {}
+static inline void failsafe_stretch_watchdog(uint32_t ms) {}
+static inline void failsafe_restore_watchdog() {}
+
+#endif
+
+#endif
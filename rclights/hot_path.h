@@ -0,0 +1,31 @@
+// ********************************************************************************
+// Placement of the per-frame code path.
+//
+// Like input_pwm.h, this header does not depend on the Pico SDK.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_HOT_PATH_H
+#define RCLIGHTS_HOT_PATH_H
+
+/* Code runs from flash through the XIP cache by default, and a cache
+   miss stalls the loop for as long as the flash takes to answer.
+   Building with RCLIGHTS_HOT_PATH_IN_RAM set to 1 places every
+   function wrapped in RCLIGHTS_HOT_FUNC() in the .time_critical
+   sections, which the SDK linker scripts copy to SRAM at boot, so the
+   time per frame no longer depends on what else went through the
+   cache.  The wrapper works like __not_in_flash_func() of the SDK:
+
+     hi_us_t RCLIGHTS_HOT_FUNC(filter_input_pwm_hi_us)() { ... }
+
+   On the host it expands to the bare name. */
+#ifndef RCLIGHTS_HOT_PATH_IN_RAM
+#define RCLIGHTS_HOT_PATH_IN_RAM 0
+#endif
+
+#if RCLIGHTS_HOT_PATH_IN_RAM
+#define RCLIGHTS_HOT_FUNC(name) __attribute__((section(".time_critical." #name))) name
+#else
+#define RCLIGHTS_HOT_FUNC(name) name
+#endif
+
+#endif
@@ -0,0 +1,412 @@
+// ********************************************************************************
+// Measuring of input PWM
+// ********************************************************************************
+
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/irq.h"
+#include "input_capture.h"
+#include "sys_clock.h"
+#include "latency.h"
+#include "metrics.h"
+#include "hot_path.h"
+
+const uint INPUT_PIN = 27;
+const uint INPUT_SLICE = 5;
+
+const float INPUT_PWM_SYS_CLK_DIV = SYS_CLK_DIV_TO_1MHZ; // this value divides the system clock frequency to slow down the PWM measuring slice/component, a value of 125 at 125 MHz slows down the PWM slice to 1 MHz or 1 PWM measure cycle per microsecond.
+
+uint32_t input_pwm_tail_us = 0;
+
+#define INPUT_ALARM_POOL_TIMERS 4 // the wake-up timers of the serial input and of the failsafe
+
+alarm_pool_t* input_alarm_pool() {
+  static alarm_pool_t* core1_pool = NULL;
+
+  if (get_core_num() == 0) {
+    return alarm_pool_get_default();
+  }
+
+  if (!core1_pool) {
+    core1_pool = alarm_pool_create_with_unused_hardware_alarm(INPUT_ALARM_POOL_TIMERS);
+  }
+
+  return core1_pool;
+}
+
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_GATE
+
+uint init_pwm_measuring() {
+  // Sanity checks
+  assert(clock_get_hz(clk_sys)            == SYS_CLK_FREQ);
+  assert(pwm_gpio_to_channel(INPUT_PIN)   == PWM_CHAN_B);
+  assert(pwm_gpio_to_slice_num(INPUT_PIN) == INPUT_SLICE);
+
+  gpio_set_function(INPUT_PIN, GPIO_FUNC_PWM);
+  pwm_set_clkdiv_mode(INPUT_SLICE, PWM_DIV_B_HIGH);
+  pwm_set_clkdiv(INPUT_SLICE, INPUT_PWM_SYS_CLK_DIV);
+  pwm_set_wrap(INPUT_SLICE, INPUT_PWM_COUNTER_MAX); 
+}
+
+/* Every gate window yields a new measurement. */
+bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_ready)() {
+  return true;
+}
+
+hi_us_t RCLIGHTS_HOT_FUNC(measure_input_pwm_hi_us)() {
+  pwm_set_counter(INPUT_SLICE, 0);
+  pwm_set_enabled(INPUT_SLICE, true);
+  sleep_ms(INPUT_PWM_PERIOD_MS);
+  pwm_set_enabled(INPUT_SLICE, false);
+
+  hi_us_t hi_us = HI_US(pwm_get_counter(INPUT_SLICE));
+  input_pwm_tail_us = time_us_32();
+
+  /* printf("hi_us = %f\n", hi_us); */
+
+  return hi_us;
+}
+
+#elif INPUT_CAPTURE_MODE == INPUT_CAPTURE_EDGE
+
+#define INPUT_EDGE_RING_SIZE 16 // must be a power of two, one frame produces two edges
+
+struct InputEdge {
+  uint32_t us;
+  bool rising;
+};
+
+/* The IRQ handler is the only writer of the ring and of
+   input_edge_count, the count of edges recorded since boot.  Readers
+   only look at entries older than the count they read, and the ring
+   holds several frames worth of edges, so a reader scanning it is
+   never overtaken by the writer. */
+static volatile struct InputEdge input_edges[INPUT_EDGE_RING_SIZE];
+static volatile uint32_t input_edge_count = 0;
+
+static uint32_t consumed_fall_count = 0; // edge count of the falling edge of the last pulse read
+static hi_us_t last_hi_us = 0;
+
+static void RCLIGHTS_HOT_FUNC(record_input_edge)(uint32_t us, bool rising) {
+  volatile struct InputEdge* edge = &input_edges[input_edge_count & (INPUT_EDGE_RING_SIZE - 1)];
+
+  edge->us = us;
+  edge->rising = rising;
+  input_edge_count++;
+}
+
+static void RCLIGHTS_HOT_FUNC(input_edge_callback)(uint gpio, uint32_t events) {
+  const uint32_t curr_us = time_us_32();
+
+  if ((events & GPIO_IRQ_EDGE_RISE) && (events & GPIO_IRQ_EDGE_FALL)) {
+    /* Both edges latched before we got here, the current level tells
+       which one came last. */
+    bool high = gpio_get(gpio);
+    record_input_edge(curr_us, !high);
+    record_input_edge(curr_us, high);
+  } else {
+    record_input_edge(curr_us, events & GPIO_IRQ_EDGE_RISE);
+  }
+}
+
+uint init_pwm_measuring() {
+  gpio_init(INPUT_PIN);
+  gpio_set_dir(INPUT_PIN, GPIO_IN);
+  gpio_set_irq_enabled_with_callback(INPUT_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &input_edge_callback);
+}
+
+/* The following function looks for the newest falling edge that
+   follows a rising edge.  On success it returns the edge count right
+   after that falling edge and stores the width of the pulse in
+   hi_us and the time of the falling edge in tail_us.  It returns 0
+   when the ring holds no complete pulse. */
+static uint32_t RCLIGHTS_HOT_FUNC(latest_input_pulse)(uint32_t* hi_us, uint32_t* tail_us) {
+  const uint32_t count = input_edge_count;
+  const uint32_t oldest = count > INPUT_EDGE_RING_SIZE ? count - INPUT_EDGE_RING_SIZE : 0;
+
+  for (uint32_t i = count; i > oldest + 1; i--) {
+    volatile struct InputEdge* fall = &input_edges[(i - 1) & (INPUT_EDGE_RING_SIZE - 1)];
+    volatile struct InputEdge* rise = &input_edges[(i - 2) & (INPUT_EDGE_RING_SIZE - 1)];
+
+    if (!fall->rising && rise->rising) {
+      *hi_us = fall->us - rise->us; // unsigned difference survives the wrap of time_us_32()
+      *tail_us = fall->us;
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+/* True when a complete pulse arrived since the last call to
+   measure_input_pwm_hi_us(). */
+bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_ready)() {
+  uint32_t hi_us;
+  uint32_t tail_us;
+  uint32_t fall_count = latest_input_pulse(&hi_us, &tail_us);
+
+  return fall_count != 0 && fall_count != consumed_fall_count;
+}
+
+/* Returns the width of the latest complete pulse without waiting.
+   When no new pulse arrived, the previous width is returned. */
+hi_us_t RCLIGHTS_HOT_FUNC(measure_input_pwm_hi_us)() {
+  uint32_t hi_us;
+  uint32_t tail_us;
+  uint32_t fall_count = latest_input_pulse(&hi_us, &tail_us);
+
+  if (fall_count != 0 && fall_count != consumed_fall_count) {
+    consumed_fall_count = fall_count;
+
+    if (hi_us <= INPUT_PWM_COUNTER_MAX) { // longer than a frame means we missed edges
+      last_hi_us = HI_US(hi_us);
+      input_pwm_tail_us = tail_us;
+    }
+  }
+
+  /* printf("hi_us = %f\n", last_hi_us); */
+
+  return last_hi_us;
+}
+
+#elif INPUT_CAPTURE_MODE == INPUT_CAPTURE_WRAP
+
+/* Slice INPUT_SLICE only advances while the input is high, so its
+   own wrap cannot pace the windows.  A second slice, not connected to
+   any pin, free-runs at the same rate and wraps once per input
+   period; its wrap IRQ closes one window and opens the next. */
+const uint INPUT_TIMEBASE_SLICE = 7;
+
+/* Double buffer of finished windows.  The IRQ handler writes the slot
+   that is not the newest and then flips input_newest_sample, so a
+   reader always sees a complete value. */
+static volatile uint16_t input_samples[2];
+static volatile uint32_t input_sample_tail_us[2];
+static volatile uint8_t input_newest_sample = 0;
+static volatile uint32_t input_sample_count = 0;
+
+static uint32_t consumed_sample_count = 0;
+
+static void RCLIGHTS_HOT_FUNC(input_timebase_wrap_handler)() {
+  static uint16_t prev_counter = 0;
+
+  pwm_clear_irq(INPUT_TIMEBASE_SLICE);
+
+  /* The gate slice wraps at 0xffff, so the difference of two
+     readings is the high time in between even across its wrap. */
+  uint16_t counter = pwm_get_counter(INPUT_SLICE);
+  uint8_t slot = input_newest_sample ^ 1;
+
+  input_samples[slot] = counter - prev_counter;
+  input_sample_tail_us[slot] = time_us_32();
+  input_newest_sample = slot;
+  input_sample_count++;
+
+  prev_counter = counter;
+}
+
+uint init_pwm_measuring() {
+  // Sanity checks
+  assert(clock_get_hz(clk_sys)            == SYS_CLK_FREQ);
+  assert(pwm_gpio_to_channel(INPUT_PIN)   == PWM_CHAN_B);
+  assert(pwm_gpio_to_slice_num(INPUT_PIN) == INPUT_SLICE);
+
+  gpio_set_function(INPUT_PIN, GPIO_FUNC_PWM);
+  pwm_set_clkdiv_mode(INPUT_SLICE, PWM_DIV_B_HIGH);
+  pwm_set_clkdiv(INPUT_SLICE, INPUT_PWM_SYS_CLK_DIV);
+  pwm_set_wrap(INPUT_SLICE, 0xffff);
+  pwm_set_counter(INPUT_SLICE, 0);
+
+  pwm_set_clkdiv_mode(INPUT_TIMEBASE_SLICE, PWM_DIV_FREE_RUNNING);
+  pwm_set_clkdiv(INPUT_TIMEBASE_SLICE, INPUT_PWM_SYS_CLK_DIV);
+  pwm_set_wrap(INPUT_TIMEBASE_SLICE, INPUT_PWM_COUNTER_MAX - 1); // one wrap per input period
+  pwm_set_counter(INPUT_TIMEBASE_SLICE, 0);
+
+  pwm_clear_irq(INPUT_TIMEBASE_SLICE);
+  pwm_set_irq_enabled(INPUT_TIMEBASE_SLICE, true);
+  irq_set_exclusive_handler(PWM_IRQ_WRAP, input_timebase_wrap_handler);
+  irq_set_enabled(PWM_IRQ_WRAP, true);
+
+  // Start both slices on the same cycle
+  pwm_set_mask_enabled(pwm_hw->en | (1u << INPUT_SLICE) | (1u << INPUT_TIMEBASE_SLICE));
+}
+
+/* True when a window finished since the last call to
+   measure_input_pwm_hi_us(). */
+bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_ready)() {
+  return input_sample_count != consumed_sample_count;
+}
+
+/* Returns the high time of the newest finished window without
+   waiting. */
+hi_us_t RCLIGHTS_HOT_FUNC(measure_input_pwm_hi_us)() {
+  consumed_sample_count = input_sample_count;
+
+  const uint8_t slot = input_newest_sample;
+  hi_us_t hi_us = HI_US(input_samples[slot]);
+  input_pwm_tail_us = input_sample_tail_us[slot];
+
+  /* printf("hi_us = %f\n", hi_us); */
+
+  return hi_us;
+}
+
+#elif INPUT_CAPTURE_MODE == INPUT_CAPTURE_HIRES
+
+/* The gate slice runs at the system clock and only advances while
+   the input is high, so it holds still from a falling edge to the
+   next rising edge.  The wrap IRQ extends its 16 bit count to 32 bits
+   and the falling edge IRQ reads the extended count while it holds
+   still.  The difference between two readings is the high time of
+   one pulse in cycles, 8 ns each at 125 MHz. */
+#define INPUT_HIRES_CYCLES_PER_US (SYS_CLK_KHZ / 1000)
+
+static volatile uint32_t input_hires_wraps = 0;
+
+/* Double buffer of finished pulses as in the wrap mode, with widths
+   already converted to hi_us_t. */
+static volatile hi_us_t input_hires_samples[2];
+static volatile uint32_t input_hires_tail_us[2];
+static volatile uint8_t input_hires_newest = 0;
+static volatile uint32_t input_hires_count = 0;
+
+static uint32_t consumed_hires_count = 0;
+
+/* Also called from the falling edge IRQ, see input_hires_cycles().
+   Clearing the flag there leaves the IRQ pending in the NVIC, so the
+   handler runs once more right after; it counts a wrap only while the
+   flag is set, so that the wrap is counted once. */
+static void RCLIGHTS_HOT_FUNC(input_hires_wrap_handler)() {
+  if (pwm_hw->intr & (1u << INPUT_SLICE)) {
+    pwm_clear_irq(INPUT_SLICE);
+    input_hires_wraps++;
+  }
+}
+
+/* Runs from the falling edge IRQ, normally while the counter holds
+   still.  A wrap right before the edge may still have its IRQ
+   pending, in which case the counter has already started over and the
+   wrap is accounted here.  The counter is read before and after the
+   flag: should the IRQ come so late that the next pulse runs the
+   counter on, a wrap between the two readings shows as a smaller
+   second one, whose flag is set by then if the first reading missed
+   it.
+
+   A single flag holds a single wrap, so a width is still short by a
+   counter period for every further wrap while interrupts stay masked
+   longer than 65536 cycles of high input, 524 us at 125 MHz and
+   262 us at 250 MHz.  Rendering masks them for tens of microseconds,
+   within that bound; the flash writes of calibration and trace
+   saves mask them for tens of milliseconds, and the pulses they
+   overlap may come out short. */
+static uint32_t RCLIGHTS_HOT_FUNC(input_hires_cycles)() {
+  uint32_t counter = pwm_get_counter(INPUT_SLICE);
+  bool wrapped = pwm_hw->intr & (1u << INPUT_SLICE);
+  const uint32_t again = pwm_get_counter(INPUT_SLICE);
+
+  if (again < counter) {
+    counter = again;
+    wrapped = true;
+  }
+
+  if (wrapped) {
+    input_hires_wrap_handler();
+  }
+
+  return (input_hires_wraps << 16) | counter;
+}
+
+static void RCLIGHTS_HOT_FUNC(input_hires_fall_callback)(uint gpio, uint32_t events) {
+  static uint32_t prev_cycles = 0;
+  static bool started = false;
+
+  const uint32_t curr_us = time_us_32();
+  const uint32_t cycles = input_hires_cycles();
+  const uint32_t hi_cycles = cycles - prev_cycles;
+
+  prev_cycles = cycles;
+
+  /* The first pulse may have started before the slice did, and one
+     longer than a frame means edges were missed. */
+  if (!started || hi_cycles > INPUT_PWM_COUNTER_MAX * INPUT_HIRES_CYCLES_PER_US) {
+    started = true;
+    return;
+  }
+
+  uint8_t slot = input_hires_newest ^ 1;
+
+#if INPUT_PWM_FLOAT
+  input_hires_samples[slot] = (float)hi_cycles / INPUT_HIRES_CYCLES_PER_US;
+#else
+  input_hires_samples[slot] = ((hi_cycles << HI_US_FRAC_BITS) + INPUT_HIRES_CYCLES_PER_US / 2) / INPUT_HIRES_CYCLES_PER_US;
+#endif
+  input_hires_tail_us[slot] = curr_us;
+  input_hires_newest = slot;
+  input_hires_count++;
+}
+
+uint init_pwm_measuring() {
+  // Sanity checks
+  assert(clock_get_hz(clk_sys)            == SYS_CLK_FREQ);
+  assert(pwm_gpio_to_channel(INPUT_PIN)   == PWM_CHAN_B);
+  assert(pwm_gpio_to_slice_num(INPUT_PIN) == INPUT_SLICE);
+
+  gpio_set_function(INPUT_PIN, GPIO_FUNC_PWM);
+  pwm_set_clkdiv_mode(INPUT_SLICE, PWM_DIV_B_HIGH);
+  pwm_set_clkdiv(INPUT_SLICE, 1);
+  pwm_set_wrap(INPUT_SLICE, 0xffff);
+  pwm_set_counter(INPUT_SLICE, 0);
+
+  pwm_clear_irq(INPUT_SLICE);
+  pwm_set_irq_enabled(INPUT_SLICE, true);
+  irq_set_exclusive_handler(PWM_IRQ_WRAP, input_hires_wrap_handler);
+  irq_set_enabled(PWM_IRQ_WRAP, true);
+
+  /* The pad input stays enabled under the PWM function, so the GPIO
+     IRQ still sees the edges. */
+  gpio_set_irq_enabled_with_callback(INPUT_PIN, GPIO_IRQ_EDGE_FALL, true, &input_hires_fall_callback);
+
+  pwm_set_enabled(INPUT_SLICE, true);
+}
+
+/* True when a pulse ended since the last call to
+   measure_input_pwm_hi_us(). */
+bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_ready)() {
+  return input_hires_count != consumed_hires_count;
+}
+
+/* Returns the width of the newest pulse, with all fractional bits of
+   hi_us_t filled in, without waiting. */
+hi_us_t RCLIGHTS_HOT_FUNC(measure_input_pwm_hi_us)() {
+  consumed_hires_count = input_hires_count;
+
+  const uint8_t slot = input_hires_newest;
+  hi_us_t hi_us = input_hires_samples[slot];
+  input_pwm_tail_us = input_hires_tail_us[slot];
+
+  return hi_us;
+}
+
+#elif !INPUT_CAPTURE_CHANNELS // implemented in input_channels.c
+#error "Unknown INPUT_CAPTURE_MODE"
+#endif
+
+volatile uint32_t input_frame_count = 0;
+hi_us_t input_frame_hi_us = 0;
+
+/* Called by the filters, so the measurement, which blocks in the
+   gate mode, counts as capture wait and the rest as filtering. */
+hi_us_t RCLIGHTS_HOT_FUNC(next_input_pwm_hi_us)() {
+  metrics_stage(METRICS_CAPTURE_WAIT);
+
+  hi_us_t hi_us = measure_input_pwm_hi_us();
+
+  metrics_stage(METRICS_FILTER);
+
+  latency_note_input(hi_us, input_pwm_tail_us);
+
+  input_frame_hi_us = hi_us;
+  input_frame_count++;
+
+  return hi_us;
+}
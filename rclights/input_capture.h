@@ -0,0 +1,68 @@
+// ********************************************************************************
+// Measuring of input PWM
+// ********************************************************************************
+
+#ifndef RCLIGHTS_INPUT_CAPTURE_H
+#define RCLIGHTS_INPUT_CAPTURE_H
+
+#include "pico/stdlib.h"
+#include "input_pwm.h"
+
+/* Input capture modes.  The gate mode counts, on a PWM slice, the
+   microseconds the input is high during one period-long window and
+   blocks for the whole window.  The edge mode timestamps input edges
+   from a GPIO IRQ and never blocks; the main loop reads the latest
+   complete pulse instead.  The wrap mode keeps the gate slice
+   counting continuously and latches its count on every wrap of a
+   free-running timebase slice, so it does not block either.  The
+   serial modes read a receiver protocol instead of a pulse, the PIO
+   mode times several servo pulses on PIO state machines and the PPM
+   mode times the channels of one PPM stream; see input_channels.h.
+   The hires mode counts system clock cycles while the input is high,
+   extends the 16 bit count of the slice on its wraps and reads it on
+   every falling edge, for widths finer than a microsecond. */
+#define INPUT_CAPTURE_GATE 0
+#define INPUT_CAPTURE_EDGE 1
+#define INPUT_CAPTURE_WRAP 2
+#define INPUT_CAPTURE_SBUS 3
+#define INPUT_CAPTURE_IBUS 4
+#define INPUT_CAPTURE_CRSF 5
+#define INPUT_CAPTURE_PIO 6
+#define INPUT_CAPTURE_PPM 7
+#define INPUT_CAPTURE_HIRES 8
+
+#ifndef INPUT_CAPTURE_MODE
+#define INPUT_CAPTURE_MODE INPUT_CAPTURE_EDGE
+#endif
+
+#define INPUT_CAPTURE_SERIAL (INPUT_CAPTURE_MODE >= INPUT_CAPTURE_SBUS && INPUT_CAPTURE_MODE <= INPUT_CAPTURE_CRSF)
+#define INPUT_CAPTURE_CHANNELS (INPUT_CAPTURE_MODE >= INPUT_CAPTURE_SBUS && INPUT_CAPTURE_MODE <= INPUT_CAPTURE_PPM)
+
+/* With RCLIGHTS_SLEEP_WHEN_IDLE set to 1, the main loop sleeps with
+   __wfi() until input_pwm_hi_us_ready() turns true.  Every capture
+   mode therefore raises an interrupt on the core that called
+   init_pwm_measuring() whenever it might: the edge and wrap modes on
+   every edge and wrap, the PIO and PPM modes on every pulse through
+   the PIO IRQ flag of the state machine, the hires mode on every
+   falling edge and slice wrap, and the serial modes, whose
+   bytes reach the ring without interrupting, on a wake-up timer.  The
+   gate mode blocks in sleep_ms() instead. */
+#ifndef RCLIGHTS_SLEEP_WHEN_IDLE
+#define RCLIGHTS_SLEEP_WHEN_IDLE 0
+#endif
+
+/* Timers of the default alarm pool interrupt core 0, which created
+   it, so they cannot wake a loop sleeping on core 1.  The following
+   function returns the default pool on core 0 and, on core 1, a pool
+   of its own, created on the first call, for the wake-up timers of
+   the core that decodes the input. */
+alarm_pool_t* input_alarm_pool();
+
+/* Time, in time_us_32() microseconds, at which the pulse returned by
+   the last call to measure_input_pwm_hi_us() ended. */
+extern uint32_t input_pwm_tail_us;
+
+uint init_pwm_measuring();
+hi_us_t measure_input_pwm_hi_us();
+
+#endif
@@ -0,0 +1,70 @@
+// ********************************************************************************
+// Multi-channel input
+// ********************************************************************************
+
+#include "input_channels.h"
+#include "hot_path.h"
+
+#if INPUT_CAPTURE_CHANNELS
+
+struct RcFrame input_channels;
+
+static uint32_t input_channels_count = 0;
+static uint32_t input_channels_tail_us = 0;
+static uint32_t consumed_channels_count = 0;
+
+/* A frame the receiver marks as failsafe carries the failsafe values
+   of the receiver rather than the sticks, so it is dropped as if it
+   never arrived: the lights hold the last state and, with
+   RCLIGHTS_FAILSAFE, failsafe.c switches to its own state once
+   enough frames went missing.  Channels a frame does not carry keep
+   their last values. */
+static bool RCLIGHTS_HOT_FUNC(poll_input_channels)() {
+  struct RcFrame frame = input_channels;
+
+  if (!receive_input_channels(&frame) || frame.failsafe) {
+    return false;
+  }
+
+  input_channels = frame;
+  input_channels_count++;
+  input_channels_tail_us = time_us_32();
+
+  return true;
+}
+
+/* True when a frame arrived since the last call to
+   measure_input_pwm_hi_us(). */
+bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_ready)() {
+  poll_input_channels();
+
+  return input_channels_count != consumed_channels_count;
+}
+
+/* Returns the width of the mix channel in the latest frame. */
+hi_us_t RCLIGHTS_HOT_FUNC(measure_input_pwm_hi_us)() {
+  consumed_channels_count = input_channels_count;
+  input_pwm_tail_us = input_channels_tail_us;
+
+  return HI_US(input_channels.us[RC_MIX_CHANNEL]);
+}
+
+/* Frames carry the state of every light function on a channel of its
+   own, so there is no noise to filter and no latency to account for
+   other than the arrival of the frame. */
+uint8_t RCLIGHTS_HOT_FUNC(input_channels_master_lights_state)() {
+  poll_input_channels();
+
+  /* A frame may also have been received by input_pwm_hi_us_ready(),
+     which the sleeping loop calls before every wake-up. */
+  if (input_channels_count != consumed_channels_count) {
+    consumed_channels_count = input_channels_count;
+    input_pwm_tail_us = input_channels_tail_us;
+    input_frame_hi_us = HI_US(input_channels.us[RC_MIX_CHANNEL]);
+    input_frame_count++;
+  }
+
+  return rc_frame_to_master_lights_state(&input_channels);
+}
+
+#endif
@@ -0,0 +1,34 @@
+// ********************************************************************************
+// Multi-channel input
+//
+// The serial and PIO capture modes receive several RC channels at
+// once.  Their backends fill a struct RcFrame, and this module puts
+// it to use in two ways: the functions of input_capture.h work on
+// channel RC_MIX_CHANNEL, so filters and decoder treat it like the
+// single servo pulse, and input_channels_master_lights_state() maps
+// every channel to the light function it drives.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_INPUT_CHANNELS_H
+#define RCLIGHTS_INPUT_CHANNELS_H
+
+#include "input_capture.h"
+#include "rc_channels.h"
+
+#if INPUT_CAPTURE_CHANNELS
+
+/* Latest complete frame, zeroed until the first one arrives. */
+extern struct RcFrame input_channels;
+
+/* Implemented by the backend of the capture mode.  Takes in whatever
+   arrived since the last call and returns true when that completed
+   at least one frame, which is then stored in frame. */
+bool receive_input_channels(struct RcFrame* frame);
+
+/* Receives and returns the master lights state the channels of the
+   latest frame map to, see RC_CHANNEL_RULES. */
+uint8_t input_channels_master_lights_state();
+
+#endif
+
+#endif
@@ -0,0 +1,252 @@
+// ********************************************************************************
+// Filtering of noise in input PWM values.
+// ********************************************************************************
+
+#include <string.h>
+#include "input_filter.h"
+#include "master_state.h"
+#include "hot_path.h"
+
+static uint8_t avg_curr_sample = 0;
+static hi_us_t avg_samples[INPUT_PWM_AVG_SAMPLES + 1];
+static hi_us_t avg_hi_us = 0;
+
+static hi_us_t smooth_hi_us = 0;
+static uint8_t smooth_curr_sample = 0;
+static hi_us_t smooth_samples[INPUT_PWM_SMOOTH_SAMPLES];
+
+static hi_us_t accept_hi_us = 0;
+static uint8_t accept_confirm_state = MASTER_LIGHTS_OFF_STATE;
+static uint8_t accept_confirm_count = 0;
+
+static hi_us_t median_hi_us = 0;
+static uint8_t median_curr_sample = 0;
+static hi_us_t median_samples[INPUT_PWM_MEDIAN_SAMPLES];
+
+void reset_input_filters() {
+  avg_curr_sample = 0;
+  memset(avg_samples, 0, sizeof(avg_samples));
+  avg_hi_us = 0;
+
+  smooth_hi_us = 0;
+  smooth_curr_sample = 0;
+  memset(smooth_samples, 0, sizeof(smooth_samples));
+
+  accept_hi_us = 0;
+  accept_confirm_state = MASTER_LIGHTS_OFF_STATE;
+  accept_confirm_count = 0;
+
+  median_hi_us = 0;
+  median_curr_sample = 0;
+  memset(median_samples, 0, sizeof(median_samples));
+}
+
+/* While a filter holds no value within the range, as after boot, it
+   takes the first reading within the range at once and fills its
+   samples with it, so the first valid decode costs one frame with
+   any filter.  A glitch at that moment is corrected the way any
+   other reading is. */
+static bool RCLIGHTS_HOT_FUNC(input_pwm_filter_seeds)(hi_us_t held_hi_us, hi_us_t hi_us) {
+  return !input_pwm_hi_us_in_range(held_hi_us) && input_pwm_hi_us_in_range(hi_us);
+}
+
+/* The following function returns the average of the last
+   INPUT_PWM_AVG_SAMPLES input values.  This is one way to workaround
+   noise in the input signal.  It trades off read cycles for a
+   sequence of values that is less bumpy but might be away from most
+   of the input values if peaks are too big. */
+hi_us_t RCLIGHTS_HOT_FUNC(average_input_pwm_hi_us)() {
+  if (!input_pwm_hi_us_ready()) {
+    return avg_hi_us;
+  }
+
+  uint8_t oldest_sample = (avg_curr_sample + 1) % (INPUT_PWM_AVG_SAMPLES + 1);
+
+  avg_samples[avg_curr_sample] = next_input_pwm_hi_us() / INPUT_PWM_AVG_SAMPLES;
+  avg_hi_us += avg_samples[avg_curr_sample] - avg_samples[oldest_sample];
+  avg_curr_sample = oldest_sample;
+
+  return avg_hi_us;
+}
+
+/* The following function returns the last smooth value until enough
+   input PWM values are the same.  INPUT_PWM_SMOOT_SAMPLES defines
+   many is enough.  This is one way to workaround noise in the input
+   signal.  It trades off read cycles for a squence of values that
+   ignores peaks but might not follow the average of the input signal
+   if there is too much noise.  */
+hi_us_t RCLIGHTS_HOT_FUNC(smooth_input_pwm_hi_us)() {
+  /* Only fresh input values count towards the samples, otherwise a
+     non-blocking capture would fill them with the same pulse. */
+  if (!input_pwm_hi_us_ready()) {
+    return smooth_hi_us;
+  }
+
+  /* You might want to experiment reading values directly or reading
+     an averaged value on the next line. */
+  hi_us_t avg_hi_us = next_input_pwm_hi_us(); // average_input_pwm_hi_us();
+  smooth_samples[smooth_curr_sample] = avg_hi_us;
+
+  /* printf("avg_hi_us = %f\n", avg_hi_us); */
+
+  if (input_pwm_filter_seeds(smooth_hi_us, avg_hi_us)) {
+    for (int i = 0; i < INPUT_PWM_SMOOTH_SAMPLES; i++) {
+      smooth_samples[i] = avg_hi_us;
+    }
+
+    smooth_hi_us = avg_hi_us;
+  } else if (avg_hi_us != smooth_hi_us) {
+    bool all_equal = true;
+
+    for (int i = 0; i < INPUT_PWM_SMOOTH_SAMPLES; i++) {
+      all_equal = all_equal && smooth_samples[i] == avg_hi_us;
+    }
+
+    if (all_equal) {
+      smooth_hi_us = avg_hi_us;
+    }
+  }
+
+  smooth_curr_sample = (smooth_curr_sample + 1) % INPUT_PWM_SMOOTH_SAMPLES;
+
+  return smooth_hi_us;
+}
+
+/* Half a bucket less the guard, the distance from the centre of a
+   bucket within which a reading is accepted right away. */
+#define INPUT_PWM_ACCEPT_MARGIN (input_pwm_range.half_bucket - HI_US(INPUT_PWM_ACCEPT_GUARD_US))
+
+static bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_near_centre)(hi_us_t hi_us) {
+  if (!input_pwm_hi_us_in_range(hi_us)) {
+    return false;
+  }
+
+  hi_us_t off_centre = hi_us - master_state_id_to_hi_us(input_pwm_hi_us_to_master_state_id(hi_us));
+
+  return off_centre <= INPUT_PWM_ACCEPT_MARGIN && -off_centre <= INPUT_PWM_ACCEPT_MARGIN;
+}
+
+/* The following function takes a new input value right away when it
+   is close to the centre of its bucket, when it decodes to the same
+   master lights state as the current value, or when the last
+   INPUT_PWM_ACCEPT_CONFIRM_SAMPLES values all decode to the same
+   state.  A clean channel thus reacts within one frame, while jitter
+   around a boundary cannot flip the state back and forth.  Unlike
+   smooth_input_pwm_hi_us(), readings only need to agree on the
+   state, not on every microsecond. */
+hi_us_t RCLIGHTS_HOT_FUNC(accept_input_pwm_hi_us)() {
+  if (!input_pwm_hi_us_ready()) {
+    return accept_hi_us;
+  }
+
+  hi_us_t hi_us = next_input_pwm_hi_us();
+  uint8_t state = input_pwm_hi_us_to_master_lights_state(hi_us);
+
+  if (state == accept_confirm_state) {
+    if (accept_confirm_count < INPUT_PWM_ACCEPT_CONFIRM_SAMPLES) {
+      accept_confirm_count++;
+    }
+  } else {
+    accept_confirm_state = state;
+    accept_confirm_count = 1;
+  }
+
+  if (accept_confirm_count >= INPUT_PWM_ACCEPT_CONFIRM_SAMPLES
+      || state == input_pwm_hi_us_to_master_lights_state(accept_hi_us)
+      || input_pwm_hi_us_near_centre(hi_us)
+      || input_pwm_filter_seeds(accept_hi_us, hi_us)) {
+    accept_hi_us = hi_us;
+  }
+
+  return accept_hi_us;
+}
+
+/* Compare and exchange for the median networks below. */
+#define INPUT_PWM_SORT2(a, b) if ((a) > (b)) { hi_us_t t = (a); (a) = (b); (b) = t; }
+
+/* The following function returns the median of the samples with a
+   fixed network of compare and exchanges, 3 for 3 samples and 7 for
+   5, whichever values they hold. */
+static hi_us_t RCLIGHTS_HOT_FUNC(median_of_samples)() {
+  hi_us_t p[INPUT_PWM_MEDIAN_SAMPLES];
+
+  memcpy(p, median_samples, sizeof(p));
+
+#if INPUT_PWM_MEDIAN_SAMPLES == 3
+  INPUT_PWM_SORT2(p[0], p[1]);
+  INPUT_PWM_SORT2(p[1], p[2]);
+  INPUT_PWM_SORT2(p[0], p[1]);
+  return p[1];
+#elif INPUT_PWM_MEDIAN_SAMPLES == 5
+  INPUT_PWM_SORT2(p[0], p[1]);
+  INPUT_PWM_SORT2(p[3], p[4]);
+  INPUT_PWM_SORT2(p[0], p[3]);
+  INPUT_PWM_SORT2(p[1], p[4]);
+  INPUT_PWM_SORT2(p[1], p[2]);
+  INPUT_PWM_SORT2(p[2], p[3]);
+  INPUT_PWM_SORT2(p[1], p[2]);
+  return p[2];
+#else
+#error "INPUT_PWM_MEDIAN_SAMPLES must be 3 or 5"
+#endif
+}
+
+/* True when hi_us lies farther than INPUT_PWM_HYSTERESIS_US past
+   the bucket of current_hi_us. */
+static bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_leaves_bucket)(hi_us_t current_hi_us, hi_us_t hi_us) {
+  if (!input_pwm_hi_us_in_range(current_hi_us)) {
+    return true; // out of the range there is no bucket to hold on to
+  }
+
+  hi_us_t off_centre = hi_us - master_state_id_to_hi_us(input_pwm_hi_us_to_master_state_id(current_hi_us));
+  const hi_us_t band = input_pwm_range.half_bucket + HI_US(INPUT_PWM_HYSTERESIS_US);
+
+  return off_centre > band || -off_centre > band;
+}
+
+/* The following function returns the running median of the last
+   INPUT_PWM_MEDIAN_SAMPLES input values, which drops any glitch
+   shorter than half of them, and holds it while the median stays
+   within INPUT_PWM_HYSTERESIS_US of the current bucket, so that
+   jitter around a boundary does not flip the state.  A step takes
+   half of the samples, rounded up, to get through. */
+hi_us_t RCLIGHTS_HOT_FUNC(median_input_pwm_hi_us)() {
+  if (!input_pwm_hi_us_ready()) {
+    return median_hi_us;
+  }
+
+  hi_us_t hi_us = next_input_pwm_hi_us();
+
+  if (input_pwm_filter_seeds(median_hi_us, hi_us)) {
+    for (int i = 0; i < INPUT_PWM_MEDIAN_SAMPLES; i++) {
+      median_samples[i] = hi_us;
+    }
+
+    median_hi_us = hi_us;
+    return median_hi_us;
+  }
+
+  median_samples[median_curr_sample] = hi_us;
+  median_curr_sample = (median_curr_sample + 1) % INPUT_PWM_MEDIAN_SAMPLES;
+
+  hi_us = median_of_samples();
+
+  if (input_pwm_hi_us_to_master_lights_state(hi_us) == input_pwm_hi_us_to_master_lights_state(median_hi_us)
+      || input_pwm_hi_us_leaves_bucket(median_hi_us, hi_us)) {
+    median_hi_us = hi_us;
+  }
+
+  return median_hi_us;
+}
+
+hi_us_t RCLIGHTS_HOT_FUNC(filter_input_pwm_hi_us)() {
+#if INPUT_FILTER_MODE == INPUT_FILTER_EQUAL
+  return smooth_input_pwm_hi_us();
+#elif INPUT_FILTER_MODE == INPUT_FILTER_ACCEPT
+  return accept_input_pwm_hi_us();
+#elif INPUT_FILTER_MODE == INPUT_FILTER_MEDIAN
+  return median_input_pwm_hi_us();
+#else
+#error "Unknown INPUT_FILTER_MODE"
+#endif
+}
@@ -0,0 +1,54 @@
+// ********************************************************************************
+// Filtering of noise in input PWM values.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_INPUT_FILTER_H
+#define RCLIGHTS_INPUT_FILTER_H
+
+#include "input_pwm.h"
+
+#define INPUT_PWM_AVG_SAMPLES 5
+
+#define INPUT_PWM_SMOOTH_SAMPLES 4
+
+/* Readings farther than this from the centre of their bucket are
+   near a boundary, where jitter flips between two states, and must
+   be confirmed by a following reading. */
+#define INPUT_PWM_ACCEPT_GUARD_US 4
+#define INPUT_PWM_ACCEPT_CONFIRM_SAMPLES 2
+
+#ifndef INPUT_PWM_MEDIAN_SAMPLES
+#define INPUT_PWM_MEDIAN_SAMPLES 3 // 3 or 5
+#endif
+
+/* How far past the boundary of the current bucket a median must lie
+   to change the state. */
+#define INPUT_PWM_HYSTERESIS_US 3
+
+/* Filter modes.  The equal filter takes a new value once
+   INPUT_PWM_SMOOTH_SAMPLES consecutive readings are exactly the same,
+   so every change costs that many frames and jitter may keep it from
+   ever converging.  The accept filter takes a reading close to the
+   centre of its bucket at once and confirms the others.  The median
+   filter drops short glitches with a running median and holds the
+   current bucket within a hysteresis band. */
+#define INPUT_FILTER_EQUAL 0
+#define INPUT_FILTER_ACCEPT 1
+#define INPUT_FILTER_MEDIAN 2
+
+#ifndef INPUT_FILTER_MODE
+#define INPUT_FILTER_MODE INPUT_FILTER_ACCEPT
+#endif
+
+hi_us_t average_input_pwm_hi_us();
+hi_us_t smooth_input_pwm_hi_us();
+hi_us_t accept_input_pwm_hi_us();
+hi_us_t median_input_pwm_hi_us();
+
+/* The filter selected by INPUT_FILTER_MODE. */
+hi_us_t filter_input_pwm_hi_us();
+
+/* Forgets every sample seen so far, as if after boot. */
+void reset_input_filters();
+
+#endif
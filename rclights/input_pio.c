@@ -0,0 +1,267 @@
+// ********************************************************************************
+// PIO pulse capture
+//
+// In the PIO capture mode, one state machine per pin times the servo
+// pulses of a receiver output and a DMA channel per state machine
+// copies every width to its word of pio_widths as it arrives.  In the
+// PPM capture mode, one state machine times the periods of a PPM
+// stream on INPUT_PIO_PINS[0] and a DMA channel copies them to a
+// ring.  Either way the CPU only reads RAM when it gets to it.
+// ********************************************************************************
+
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "input_channels.h"
+#include "leds.h"
+#include "sequencer.h"
+#include "ws2812.h"
+#include "sys_clock.h"
+#include "hot_path.h"
+
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_PIO || INPUT_CAPTURE_MODE == INPUT_CAPTURE_PPM
+
+#include "input_capture.pio.h"
+
+#define INPUT_PIO pio0
+
+/* The first pin is the input pin of the other modes, so a single
+   receiver output keeps its wiring. */
+static const uint INPUT_PIO_PINS[] = { 27, 26, 19, 16 };
+
+#define INPUT_PIO_CHANNEL_COUNT (sizeof(INPUT_PIO_PINS) / sizeof(INPUT_PIO_PINS[0]))
+
+/* Two cycles per count and 16 counts per microsecond out of the
+   system clock, 3.90625 at 125 MHz.  Below 32 MHz the state machines
+   could not keep up. */
+static const float INPUT_PIO_CLK_DIV = SYS_CLK_KHZ / (2.0f * 16 * 1000);
+
+_Static_assert(SYS_CLK_KHZ >= 2 * 16 * 1000, "system clock too slow for PIO capture");
+
+/* The DMA channels are started with the largest transfer count, good
+   for years of frames at 62 Hz and for months of PPM periods.  When
+   one runs out, it chains to a control channel shared by all of them,
+   which writes their mask to MULTI_CHAN_TRIGGER: that restarts the
+   channel that finished with the count it was configured with and
+   leaves the running ones alone, and the write address of a ring
+   carries on where it was.  One shared channel rather than one per
+   data channel, as in input_serial.c, keeps the PIO mode within the
+   12 DMA channels next to the led fades, a channel per led slice,
+   the sequencer, a channel per group, and the strip.  With all three
+   on, the four led slices of the trailer leave no channel for it, and
+   the data channels run without reload; the five of blog_car leave
+   too few for the data channels, and the build fails. */
+static const uint32_t INPUT_PIO_DMA_TRANSFERS = 0xffffffff;
+
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_PIO
+#define INPUT_PIO_DMA_DATA_CHANNELS INPUT_PIO_CHANNEL_COUNT
+#else
+#define INPUT_PIO_DMA_DATA_CHANNELS 1
+#endif
+
+#define INPUT_PIO_DMA_OTHER_CHANNELS \
+  (RCLIGHTS_LED_FADES * PROFILE_LED_SLICE_COUNT + RCLIGHTS_SEQUENCER * PROFILE_SEQUENCER_GROUP_COUNT + RCLIGHTS_WS2812)
+
+_Static_assert(INPUT_PIO_DMA_DATA_CHANNELS + INPUT_PIO_DMA_OTHER_CHANNELS <= NUM_DMA_CHANNELS,
+               "too few DMA channels for PIO capture next to the led fades, the sequencer and the strip of this profile");
+
+static int input_pio_dma_ctrl_chan = -1;
+static uint32_t input_pio_dma_reload_mask = 0;
+
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+/* The state machine that opens frames raises its IRQ flag on every
+   pulse.  The handler only has to clear it; taking the interrupt is
+   what wakes the loop. */
+static uint input_pio_wake_sm;
+
+static void RCLIGHTS_HOT_FUNC(input_pio_wake_handler)() {
+  pio_interrupt_clear(INPUT_PIO, input_pio_wake_sm);
+}
+#endif
+
+/* The following function routes the IRQ flag of sm to the interrupt
+   of the core that calls it.  The flags of the other state machines
+   stay set, which does not stall them. */
+static void init_input_pio_wake(uint sm) {
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+  input_pio_wake_sm = sm;
+  pio_interrupt_clear(INPUT_PIO, sm);
+  pio_set_irq0_source_enabled(INPUT_PIO, (enum pio_interrupt_source)(pis_interrupt0 + sm), true);
+  irq_set_exclusive_handler(PIO0_IRQ_0, input_pio_wake_handler);
+  irq_set_enabled(PIO0_IRQ_0, true);
+#endif
+}
+
+#define INPUT_PIO_COUNT_US(count) (((count) + 8) >> 4) // rounds sixteenths of a microsecond
+
+/* The following function claims the control channel for the data
+   channels of chan_mask, if one is free.  Called once the data
+   channels are claimed and before they are configured. */
+static void init_input_pio_dma_reload(uint32_t chan_mask) {
+  input_pio_dma_ctrl_chan = dma_claim_unused_channel(false);
+
+  if (input_pio_dma_ctrl_chan < 0) {
+    return;
+  }
+
+  input_pio_dma_reload_mask = chan_mask;
+
+  dma_channel_config config = dma_channel_get_default_config(input_pio_dma_ctrl_chan);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, false);
+  dma_channel_configure(input_pio_dma_ctrl_chan, &config, &dma_hw->multi_channel_trigger, &input_pio_dma_reload_mask,
+                        1, false);
+}
+
+static void init_input_pio_dma(uint chan, uint sm, volatile void* write_addr, bool write_increment, uint ring_bits) {
+  dma_channel_config config = dma_channel_get_default_config(chan);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, write_increment);
+
+  if (ring_bits) {
+    channel_config_set_ring(&config, true, ring_bits);
+  }
+
+  channel_config_set_dreq(&config, pio_get_dreq(INPUT_PIO, sm, false));
+
+  if (input_pio_dma_ctrl_chan >= 0) {
+    channel_config_set_chain_to(&config, input_pio_dma_ctrl_chan);
+  }
+
+  dma_channel_configure(chan, &config, write_addr, &INPUT_PIO->rxf[sm], INPUT_PIO_DMA_TRANSFERS, true);
+}
+
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_PIO
+
+_Static_assert(RC_SERVO_CHANNELS == INPUT_PIO_CHANNEL_COUNT,
+               "RC_SERVO_CHANNELS must match the count of INPUT_PIO_PINS");
+
+/* Latest width of each pin in counts, each written only by its DMA
+   channel. */
+static volatile uint32_t pio_widths[INPUT_PIO_CHANNEL_COUNT];
+
+static uint pio_dma_chans[INPUT_PIO_CHANNEL_COUNT];
+static uint32_t pio_seen_transfer_count = 0;
+
+uint init_pwm_measuring() {
+  uint offset = pio_add_program(INPUT_PIO, &pulse_capture_program);
+  uint32_t sm_mask = 0;
+  uint32_t chan_mask = 0;
+
+  for (uint ch = 0; ch < INPUT_PIO_CHANNEL_COUNT; ch++) {
+    pio_dma_chans[ch] = dma_claim_unused_channel(true);
+    chan_mask |= 1u << pio_dma_chans[ch];
+  }
+
+  init_input_pio_dma_reload(chan_mask);
+
+  for (uint ch = 0; ch < INPUT_PIO_CHANNEL_COUNT; ch++) {
+    uint sm = pio_claim_unused_sm(INPUT_PIO, true);
+
+    pulse_capture_program_init(INPUT_PIO, sm, offset, INPUT_PIO_PINS[ch], INPUT_PIO_CLK_DIV);
+
+    init_input_pio_dma(pio_dma_chans[ch], sm, &pio_widths[ch], false, 0);
+
+    if (ch == 0) {
+      init_input_pio_wake(sm);
+    }
+
+    sm_mask |= 1u << sm;
+  }
+
+  pio_seen_transfer_count = INPUT_PIO_DMA_TRANSFERS;
+  pio_set_sm_mask_enabled(INPUT_PIO, sm_mask, true);
+}
+
+/* A new pulse on the first pin opens a new frame.  The other pins
+   contribute their latest widths, which the receiver sent within the
+   same period.  The transfer count reads INPUT_PIO_DMA_TRANSFERS only
+   before the first pulse after the start or a reload, so that value
+   is no new pulse; the pulse that ran the count out to 0 was one. */
+bool RCLIGHTS_HOT_FUNC(receive_input_channels)(struct RcFrame* frame) {
+  const uint32_t transfer_count = dma_channel_hw_addr(pio_dma_chans[0])->transfer_count;
+
+  if (transfer_count == pio_seen_transfer_count || transfer_count == INPUT_PIO_DMA_TRANSFERS) {
+    return false;
+  }
+
+  pio_seen_transfer_count = transfer_count;
+
+  for (uint ch = 0; ch < INPUT_PIO_CHANNEL_COUNT; ch++) {
+    frame->us[ch] = INPUT_PIO_COUNT_US(pio_widths[ch]);
+  }
+
+  frame->channel_count = INPUT_PIO_CHANNEL_COUNT;
+  frame->failsafe = false;
+
+  return true;
+}
+
+#else // INPUT_CAPTURE_PPM
+
+#define INPUT_PPM_SYNC_US 2700 // periods longer than this are the gap before the first channel
+
+#define INPUT_PPM_RING_BITS 7
+#define INPUT_PPM_RING_SIZE ((1 << INPUT_PPM_RING_BITS) / sizeof(uint32_t)) // a few frames of 8 channels
+
+/* The DMA write address wraps within the ring, which therefore must
+   be aligned to its size in bytes. */
+static volatile uint32_t ppm_ring[INPUT_PPM_RING_SIZE] __attribute__((aligned(1 << INPUT_PPM_RING_BITS)));
+static uint32_t ppm_read_index = 0;
+
+static uint ppm_dma_chan;
+
+/* Channels of the frame in progress.  Until the first sync gap, the
+   periods seen are of a frame that started before capture did. */
+static struct RcFrame ppm_frame;
+static uint8_t ppm_next_channel = 0;
+static bool ppm_synced = false;
+
+uint init_pwm_measuring() {
+  uint offset = pio_add_program(INPUT_PIO, &ppm_capture_program);
+  uint sm = pio_claim_unused_sm(INPUT_PIO, true);
+
+  ppm_capture_program_init(INPUT_PIO, sm, offset, INPUT_PIO_PINS[0], INPUT_PIO_CLK_DIV);
+
+  ppm_dma_chan = dma_claim_unused_channel(true);
+  init_input_pio_dma_reload(1u << ppm_dma_chan);
+  init_input_pio_dma(ppm_dma_chan, sm, ppm_ring, true, INPUT_PPM_RING_BITS);
+  init_input_pio_wake(sm);
+
+  pio_sm_set_enabled(INPUT_PIO, sm, true);
+}
+
+/* A frame is complete at the sync gap that follows its last channel. */
+bool RCLIGHTS_HOT_FUNC(receive_input_channels)(struct RcFrame* frame) {
+  const uint32_t write_index = ((dma_channel_hw_addr(ppm_dma_chan)->write_addr - (uintptr_t)ppm_ring) / sizeof(uint32_t))
+    & (INPUT_PPM_RING_SIZE - 1);
+  bool new_frame = false;
+
+  while (ppm_read_index != write_index) {
+    const uint32_t period_us = INPUT_PIO_COUNT_US(ppm_ring[ppm_read_index]);
+
+    if (period_us > INPUT_PPM_SYNC_US) {
+      if (ppm_synced && ppm_next_channel > 0) {
+        ppm_frame.channel_count = ppm_next_channel;
+        ppm_frame.failsafe = false;
+        *frame = ppm_frame;
+        new_frame = true;
+      }
+
+      ppm_next_channel = 0;
+      ppm_synced = true;
+    } else if (ppm_next_channel < RC_CHANNEL_COUNT) {
+      ppm_frame.us[ppm_next_channel++] = period_us;
+    }
+
+    ppm_read_index = (ppm_read_index + 1) & (INPUT_PPM_RING_SIZE - 1);
+  }
+
+  return new_frame;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+// ********************************************************************************
+// Representation of input PWM pulse widths.
+//
+// This header and the filtering, decoding and rule modules do not
+// depend on the Pico SDK, so they also build on a workstation.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_INPUT_PWM_H
+#define RCLIGHTS_INPUT_PWM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static const uint32_t INPUT_PWM_FREQ = 62; // for example, a value of 50 corresponds to 50 Hz or 1 period/frame every 20 miliseconds
+static const uint32_t INPUT_PWM_PERIOD_MS = 1000 / INPUT_PWM_FREQ;
+static const uint32_t INPUT_PWM_COUNTER_UNITS_PER_SEC = 1000000; // each counter unit corresponds to 1 microsecond
+static const uint16_t INPUT_PWM_COUNTER_MAX = INPUT_PWM_COUNTER_UNITS_PER_SEC / INPUT_PWM_FREQ; // aka counter TOP or WRAP in Pico's docs, the amount of microseconds in one period/frame of the input signal
+
+/* Input pulse widths travel from measuring through filtering to
+   decoding as hi_us_t.  The RP2040 has no FPU, so by default hi_us_t
+   is a fixed point amount of microseconds with HI_US_FRAC_BITS
+   fractional bits and the whole path runs on integer instructions.
+   Building with INPUT_PWM_FLOAT set to 1 brings back the soft-float
+   path for comparison. */
+#ifndef INPUT_PWM_FLOAT
+#define INPUT_PWM_FLOAT 0
+#endif
+
+#if INPUT_PWM_FLOAT
+typedef float hi_us_t;
+#define HI_US(us) ((float)(us))
+#else
+typedef int32_t hi_us_t;
+#define HI_US_FRAC_BITS 4
+#define HI_US(us) ((hi_us_t)(us) << HI_US_FRAC_BITS) // converts whole microseconds to hi_us_t
+#endif
+
+// ********************************************************************************
+// Thin hardware layer.
+//
+// The filters read the input only through the following functions
+// and variables.  The firmware implements them in input_capture.c on
+// top of the capture hardware; the host benchmark implements them on
+// top of recorded or synthetic pulse traces.
+
+/* True when a new input value is available. */
+bool input_pwm_hi_us_ready();
+
+/* Returns the next input value and accounts for it in
+   input_frame_count and input_frame_hi_us. */
+hi_us_t next_input_pwm_hi_us();
+
+/* Count of input values read since boot and the latest of them. */
+extern volatile uint32_t input_frame_count;
+extern hi_us_t input_frame_hi_us;
+
+#endif
@@ -0,0 +1,117 @@
+// ********************************************************************************
+// Serial receiver input
+//
+// In the serial capture modes, a UART receives SBUS, iBUS or CRSF from
+// the receiver on INPUT_SERIAL_RX_PIN and a DMA channel copies every
+// byte into a ring buffer as it arrives, so no byte waits for the
+// CPU.  receive_input_channels() parses whatever arrived since it
+// last ran.
+// ********************************************************************************
+
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "input_channels.h"
+#include "hot_path.h"
+
+#if INPUT_CAPTURE_SERIAL
+
+#define INPUT_SERIAL_UART uart1
+const uint INPUT_SERIAL_RX_PIN = 5; // UART1 RX
+
+#define INPUT_SERIAL_RING_BITS 8
+#define INPUT_SERIAL_RING_SIZE (1 << INPUT_SERIAL_RING_BITS) // several frames of any of the protocols
+
+/* The DMA write address wraps within the ring, which therefore must
+   be aligned to its size. */
+static uint8_t serial_ring[INPUT_SERIAL_RING_SIZE] __attribute__((aligned(INPUT_SERIAL_RING_SIZE)));
+static uint32_t serial_read_index = 0;
+
+/* The data channel moves bytes from the UART to the ring.  When its
+   transfer count runs out, more than a day into a CRSF link, it
+   chains to the control channel, which reloads the count and
+   retriggers it. */
+static uint serial_dma_chan;
+static uint serial_dma_ctrl_chan;
+static const uint32_t SERIAL_DMA_TRANSFERS = 0xffffffff;
+
+static struct RcParser serial_parser;
+
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+/* Wakes the sleeping loop often enough to parse a frame about as
+   soon as it ends, even at the 2 ms frames of a fast CRSF link.  The
+   timer runs on the pool of the core that calls init_pwm_measuring(),
+   core 1 with RCLIGHTS_DUAL_CORE, so it wakes that core. */
+static const int64_t INPUT_SERIAL_WAKE_US = 1000;
+
+static repeating_timer_t serial_wake_timer;
+
+static bool RCLIGHTS_HOT_FUNC(serial_wake_timer_callback)(repeating_timer_t* timer) {
+  return true;
+}
+#endif
+
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_SBUS
+#define serial_parse_byte sbus_parse_byte
+#elif INPUT_CAPTURE_MODE == INPUT_CAPTURE_IBUS
+#define serial_parse_byte ibus_parse_byte
+#elif INPUT_CAPTURE_MODE == INPUT_CAPTURE_CRSF
+#define serial_parse_byte crsf_parse_byte
+#else
+#error "Unknown serial INPUT_CAPTURE_MODE"
+#endif
+
+uint init_pwm_measuring() {
+  gpio_set_function(INPUT_SERIAL_RX_PIN, GPIO_FUNC_UART);
+
+#if INPUT_CAPTURE_MODE == INPUT_CAPTURE_SBUS
+  uart_init(INPUT_SERIAL_UART, SBUS_BAUD_RATE);
+  uart_set_format(INPUT_SERIAL_UART, 8, 2, UART_PARITY_EVEN);
+  gpio_set_inover(INPUT_SERIAL_RX_PIN, GPIO_OVERRIDE_INVERT); // SBUS idles low
+#elif INPUT_CAPTURE_MODE == INPUT_CAPTURE_IBUS
+  uart_init(INPUT_SERIAL_UART, IBUS_BAUD_RATE);
+#else
+  uart_init(INPUT_SERIAL_UART, CRSF_BAUD_RATE);
+#endif
+
+  serial_dma_chan = dma_claim_unused_channel(true);
+  serial_dma_ctrl_chan = dma_claim_unused_channel(true);
+
+  dma_channel_config config = dma_channel_get_default_config(serial_dma_chan);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, true);
+  channel_config_set_ring(&config, true, INPUT_SERIAL_RING_BITS);
+  channel_config_set_dreq(&config, uart_get_dreq(INPUT_SERIAL_UART, false));
+  channel_config_set_chain_to(&config, serial_dma_ctrl_chan);
+  dma_channel_configure(serial_dma_chan, &config, serial_ring, &uart_get_hw(INPUT_SERIAL_UART)->dr,
+                        SERIAL_DMA_TRANSFERS, false);
+
+  dma_channel_config ctrl_config = dma_channel_get_default_config(serial_dma_ctrl_chan);
+  channel_config_set_transfer_data_size(&ctrl_config, DMA_SIZE_32);
+  channel_config_set_read_increment(&ctrl_config, false);
+  channel_config_set_write_increment(&ctrl_config, false);
+  dma_channel_configure(serial_dma_ctrl_chan, &ctrl_config, &dma_hw->ch[serial_dma_chan].al1_transfer_count_trig,
+                        &SERIAL_DMA_TRANSFERS, 1, false);
+
+  dma_channel_start(serial_dma_chan);
+
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+  alarm_pool_add_repeating_timer_us(input_alarm_pool(), -INPUT_SERIAL_WAKE_US, serial_wake_timer_callback, NULL,
+                                    &serial_wake_timer);
+#endif
+}
+
+bool RCLIGHTS_HOT_FUNC(receive_input_channels)(struct RcFrame* frame) {
+  const uint32_t write_index = (dma_channel_hw_addr(serial_dma_chan)->write_addr - (uintptr_t)serial_ring)
+    & (INPUT_SERIAL_RING_SIZE - 1);
+  bool new_frame = false;
+
+  while (serial_read_index != write_index) {
+    new_frame |= serial_parse_byte(&serial_parser, serial_ring[serial_read_index], frame);
+    serial_read_index = (serial_read_index + 1) & (INPUT_SERIAL_RING_SIZE - 1);
+  }
+
+  return new_frame;
+}
+
+#endif
@@ -0,0 +1,115 @@
+// ********************************************************************************
+// Latency instrumentation
+// ********************************************************************************
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "latency.h"
+#include "input_capture.h"
+#include "master_state.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_LATENCY_STATS
+
+struct LatencyStats latency_stats;
+
+/* Written on the core that decodes the input and read on the core
+   that renders the lights.  Single words, so each read is whole. */
+static uint8_t run_state = 0;         // decoded state of the latest raw pulse
+static uint32_t run_tail_us = 0;      // tail of the first pulse of the run of pulses that decoded to run_state
+static volatile uint32_t state_input_us = 0; // tail of the first pulse that decoded to the latest smoothed state
+static volatile uint32_t state_us = 0;       // time at which the smoothed state changed
+
+void RCLIGHTS_HOT_FUNC(latency_histogram_add)(struct LatencyHistogram* histogram, uint32_t latency_us) {
+  uint32_t bin = latency_us / 1000;
+
+  if (bin >= LATENCY_HISTOGRAM_BINS) {
+    bin = LATENCY_HISTOGRAM_BINS - 1;
+  }
+
+  if (histogram->count == 0 || latency_us < histogram->min_us) {
+    histogram->min_us = latency_us;
+  }
+
+  if (latency_us > histogram->max_us) {
+    histogram->max_us = latency_us;
+  }
+
+  histogram->bins[bin]++;
+  histogram->count++;
+}
+
+/* Returns the upper bound, in milliseconds, of the bin holding the
+   given percentile. */
+uint32_t latency_histogram_percentile_ms(const struct LatencyHistogram* histogram, uint32_t percentile) {
+  const uint32_t wanted = (histogram->count * percentile + 99) / 100;
+  uint32_t seen = 0;
+
+  for (uint32_t bin = 0; bin < LATENCY_HISTOGRAM_BINS; bin++) {
+    seen += histogram->bins[bin];
+
+    if (seen >= wanted) {
+      return bin + 1;
+    }
+  }
+
+  return LATENCY_HISTOGRAM_BINS;
+}
+
+void RCLIGHTS_HOT_FUNC(latency_note_input)(hi_us_t hi_us, uint32_t tail_us) {
+  uint8_t state = input_pwm_hi_us_to_master_lights_state(hi_us);
+
+  if (state != run_state) {
+    run_state = state;
+    run_tail_us = tail_us;
+  }
+}
+
+void RCLIGHTS_HOT_FUNC(latency_note_state)(uint8_t state) {
+  state_input_us = state == run_state ? run_tail_us : input_pwm_tail_us;
+  state_us = time_us_32();
+}
+
+void RCLIGHTS_HOT_FUNC(latency_note_write)() {
+  const uint32_t write_us = time_us_32();
+  const uint32_t input_us = state_input_us;
+  const uint32_t changed_us = state_us;
+
+  if (!changed_us) {
+    return; // the boot lights, rendered before any decoded state
+  }
+
+  latency_histogram_add(&latency_stats.input_to_state, changed_us - input_us);
+  latency_histogram_add(&latency_stats.state_to_write, write_us - changed_us);
+  latency_histogram_add(&latency_stats.input_to_write, write_us - input_us);
+}
+
+void latency_note_boot(uint32_t lights_us, uint32_t first_state_us) {
+  latency_stats.boot_lights_us = lights_us;
+  latency_stats.boot_first_state_us = first_state_us;
+}
+
+void latency_histogram_report(const char* name, const struct LatencyHistogram* histogram) {
+  printf("%s: count %u min %u us max %u us p50 <%u ms p90 <%u ms p99 <%u ms\n",
+         name, histogram->count, histogram->min_us, histogram->max_us,
+         latency_histogram_percentile_ms(histogram, 50),
+         latency_histogram_percentile_ms(histogram, 90),
+         latency_histogram_percentile_ms(histogram, 99));
+}
+
+void latency_report() {
+  latency_histogram_report("input to state", &latency_stats.input_to_state);
+  latency_histogram_report("state to write", &latency_stats.state_to_write);
+  latency_histogram_report("input to write", &latency_stats.input_to_write);
+  printf("boot: lights %u us first valid state %u us\n",
+         latency_stats.boot_lights_us, latency_stats.boot_first_state_us);
+}
+
+/* Prints the report on the 'l' command. */
+void latency_handle_command(int command) {
+  if (command == 'l') {
+    latency_report();
+  }
+}
+
+#endif
@@ -0,0 +1,73 @@
+// ********************************************************************************
+// Latency instrumentation
+//
+// With RCLIGHTS_LATENCY_STATS set to 1, the functions of this module keep
+// histograms of how long it takes from the end of an input pulse to
+// the change of the smoothed master lights state, and from there to
+// the write of the leds.  The input side of one change is the tail of
+// the first pulse that decoded to the new state, so filter latency is
+// included.  The histograms live in latency_stats, which a debugger
+// can read at any time, and latency_report() prints them on demand.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_LATENCY_H
+#define RCLIGHTS_LATENCY_H
+
+#include "input_pwm.h"
+
+#ifndef RCLIGHTS_LATENCY_STATS
+#define RCLIGHTS_LATENCY_STATS 0
+#endif
+
+#if RCLIGHTS_LATENCY_STATS
+
+#define LATENCY_HISTOGRAM_BINS 128 // one millisecond each, the last one also counts anything longer
+
+struct LatencyHistogram {
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint32_t bins[LATENCY_HISTOGRAM_BINS];
+};
+
+struct LatencyStats {
+  struct LatencyHistogram input_to_state;
+  struct LatencyHistogram state_to_write;
+  struct LatencyHistogram input_to_write;
+  uint32_t boot_lights_us;       // from power-on to the boot state on the leds
+  uint32_t boot_first_state_us;  // from power-on to the first valid decode, 0 until then
+};
+
+extern struct LatencyStats latency_stats;
+
+/* Called on every new raw input value, on the core that decodes. */
+void latency_note_input(hi_us_t hi_us, uint32_t tail_us);
+
+/* Called when the smoothed master lights state changes, on the core
+   that decodes. */
+void latency_note_state(uint8_t state);
+
+/* Called right after the leds were written for a new state, on the
+   core that renders. */
+void latency_note_write();
+
+/* Called once, on the first valid decode, with the time_us_32() at
+   which the boot state was rendered and at which the decode came. */
+void latency_note_boot(uint32_t lights_us, uint32_t first_state_us);
+
+void latency_report();
+
+/* Handles a command character read from stdio, see latency.c. */
+void latency_handle_command(int command);
+
+#else
+
+static inline void latency_note_input(hi_us_t hi_us, uint32_t tail_us) {}
+static inline void latency_note_state(uint8_t state) {}
+static inline void latency_note_write() {}
+static inline void latency_note_boot(uint32_t lights_us, uint32_t first_state_us) {}
+static inline void latency_handle_command(int command) {}
+
+#endif
+
+#endif
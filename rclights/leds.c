@@ -0,0 +1,470 @@
+// ********************************************************************************
+// Data structure Led and corresponding operations that control leds
+// connected to GPIO pins.
+// ********************************************************************************
+
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+#include <math.h>
+#include "leds.h"
+#include "latency.h"
+#include "ws2812.h"
+#include "metrics.h"
+#include "sys_clock.h"
+#include "hot_path.h"
+
+#define LED_OF_PROFILE(arg, name, pin, base, on_bits, blink_bits, hi_bits, blink_group) \
+  [name] = {                                                                             \
+    .id = pin,                                                                           \
+    .pwm_slice = -1,                                                                     \
+    .pwm_chan = -1,                                                                      \
+    .level = 0,                                                                          \
+  },
+
+struct Led LEDS[LED_COUNT] = {
+  PROFILE_LEDS(LED_OF_PROFILE, 0)
+};
+
+/* Compare registers as last written by commit_leds(), one per slice.
+   Each register holds the levels of both channels of its slice. */
+static uint32_t committed_cc[NUM_PWM_SLICES];
+static uint32_t led_slices_mask = 0;
+
+#if RCLIGHTS_LED_FADES
+
+/* Fades take one step per PWM period, so the led slices run at a
+   couple of kHz instead, with a 12 bit wrap fine enough that the
+   lowest steps of a ramp do not show. */
+#define OUTPUT_FADE_WRAP 4095
+#define OUTPUT_FADE_PWM_FREQ 2000 // periods, and fade steps, per second
+
+#ifndef OUTPUT_FADE_MS
+#define OUTPUT_FADE_MS 120 // from off to hi
+#endif
+
+#define OUTPUT_FADE_STEPS (OUTPUT_FADE_MS * OUTPUT_FADE_PWM_FREQ / 1000)
+
+static const float OUTPUT_FADE_GAMMA = 2.2f;
+
+static const float OUTPUT_PWM_SYS_CLK_DIV = SYS_CLK_KHZ * 1000.0f / ((OUTPUT_FADE_WRAP + 1) * OUTPUT_FADE_PWM_FREQ);
+static const uint16_t OUTPUT_PWM_WRAP = OUTPUT_FADE_WRAP;
+
+/* Converts a level of the rules, out of OUTPUT_PWM_MAX_LEVEL, to
+   compare counts.  Full level is one past the wrap, which keeps the
+   output high. */
+#define OUTPUT_PWM_COUNTS(level) ((uint32_t)(level) * (OUTPUT_FADE_WRAP + 1) / OUTPUT_PWM_MAX_LEVEL)
+
+#else
+
+/* The led slices keep the PWM frequency they have at 125 MHz where
+   the system clock allows it.  Slower clocks cannot be divided by
+   less than 1 and run them slower. */
+static const float OUTPUT_PWM_SYS_CLK_DIV = SYS_CLK_KHZ > 125000 ? SYS_CLK_KHZ / 125000.0f : 1.0f;
+static const uint16_t OUTPUT_PWM_WRAP = OUTPUT_PWM_MAX_LEVEL;
+
+#define OUTPUT_PWM_COUNTS(level) (level)
+
+#endif
+
+void init_led(struct Led* led) {
+  led->pwm_slice = pwm_gpio_to_slice_num(led->id);
+  led->pwm_chan = pwm_gpio_to_channel(led->id);
+
+  gpio_set_function(led->id, GPIO_FUNC_PWM);
+  pwm_set_clkdiv(led->pwm_slice, OUTPUT_PWM_SYS_CLK_DIV);
+  pwm_set_wrap(led->pwm_slice, OUTPUT_PWM_WRAP);
+  pwm_set_counter(led->pwm_slice, 0);
+
+  led_slices_mask |= 1u << led->pwm_slice;
+}
+
+#if RCLIGHTS_LED_FADES
+
+/* For every led state, a ramp up to its level from off and a ramp
+   down to it from full, in steps evenly spaced in perceived
+   brightness, which goes as the gamma root of the duty cycle.  The
+   last step of a ramp is the level itself.  Whatever level a led is
+   at lies on one of the two ramps to its next level, so a fade that
+   cuts another short picks up where the led is. */
+enum FadeDirection {
+  FADE_UP,
+  FADE_DOWN,
+  FADE_DIRECTIONS,
+};
+
+static uint16_t fade_ramps[LED_STATE_COUNT][FADE_DIRECTIONS][OUTPUT_FADE_STEPS];
+static uint16_t fade_targets[LED_STATE_COUNT]; // compare counts of each led state
+
+/* Slices with two leds get a ramp of whole compare register values,
+   merged from the ramps of both when a fade starts.  Slices with one
+   led stream its ramp directly. */
+#define LED_FADE_BUFFER_COUNT (LED_COUNT / 2)
+
+static uint led_fade_chans[NUM_PWM_SLICES];
+static uint8_t led_fade_channels[NUM_PWM_SLICES]; // bit c set when channel c of the slice drives a led
+static int8_t led_fade_buffer_of_slice[NUM_PWM_SLICES];
+static uint32_t led_fade_buffers[LED_FADE_BUFFER_COUNT][OUTPUT_FADE_STEPS];
+
+static void init_fade_ramps() {
+  for (int state = 0; state < LED_STATE_COUNT; state++) {
+    const uint16_t target = OUTPUT_PWM_COUNTS(led_state_level(state));
+    const float target_brightness = powf((float)target / (OUTPUT_FADE_WRAP + 1), 1 / OUTPUT_FADE_GAMMA);
+
+    fade_targets[state] = target;
+
+    for (int k = 0; k < OUTPUT_FADE_STEPS; k++) {
+      const float t = (float)(k + 1) / OUTPUT_FADE_STEPS;
+      const float up = target_brightness * t;
+      const float down = 1 + (target_brightness - 1) * t;
+
+      fade_ramps[state][FADE_UP][k] = lroundf(powf(up, OUTPUT_FADE_GAMMA) * (OUTPUT_FADE_WRAP + 1));
+      fade_ramps[state][FADE_DOWN][k] = lroundf(powf(down, OUTPUT_FADE_GAMMA) * (OUTPUT_FADE_WRAP + 1));
+    }
+
+    fade_ramps[state][FADE_UP][OUTPUT_FADE_STEPS - 1] = target;
+    fade_ramps[state][FADE_DOWN][OUTPUT_FADE_STEPS - 1] = target;
+  }
+}
+
+static void init_led_fades() {
+  int buffer_count = 0;
+
+  init_fade_ramps();
+
+  for (uint slice = 0; slice < NUM_PWM_SLICES; slice++) {
+    led_fade_buffer_of_slice[slice] = -1;
+
+    if (!(led_slices_mask & (1u << slice))) {
+      continue;
+    }
+
+    led_fade_channels[slice] = 0;
+
+    for (int i = 0; i < LED_COUNT; i++) {
+      if (LEDS[i].pwm_slice == slice) {
+        led_fade_channels[slice] |= 1 << (LEDS[i].pwm_chan == PWM_CHAN_B);
+      }
+    }
+
+    if (led_fade_channels[slice] == 3) {
+      led_fade_buffer_of_slice[slice] = buffer_count++;
+    }
+
+    led_fade_chans[slice] = dma_claim_unused_channel(true);
+  }
+}
+
+/* The part of a ramp that is left to stream. */
+struct LedFade {
+  const uint16_t* steps;
+  uint32_t count;
+  uint16_t target;
+};
+
+/* The following function finds the ramp from compare count from to
+   compare count to and the first step of it past from.  It returns
+   false when to is not the level of any led state. */
+static bool RCLIGHTS_HOT_FUNC(find_led_fade)(uint16_t from, uint16_t to, struct LedFade* fade) {
+  int state = 0;
+
+  while (state < LED_STATE_COUNT && fade_targets[state] != to) {
+    state++;
+  }
+
+  if (state == LED_STATE_COUNT) {
+    return false;
+  }
+
+  fade->target = to;
+  fade->count = 0;
+
+  if (from == to) {
+    return true;
+  }
+
+  /* Ramps are monotonic and end at to, so the first step past from
+     is found by bisection. */
+  const bool up = from < to;
+  const uint16_t* ramp = fade_ramps[state][up ? FADE_UP : FADE_DOWN];
+  uint32_t lo = 0;
+  uint32_t hi = OUTPUT_FADE_STEPS - 1;
+
+  while (lo < hi) {
+    const uint32_t mid = (lo + hi) / 2;
+
+    if (up ? ramp[mid] > from : ramp[mid] < from) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  fade->steps = &ramp[lo];
+  fade->count = OUTPUT_FADE_STEPS - lo;
+
+  return true;
+}
+
+static uint16_t RCLIGHTS_HOT_FUNC(led_fade_step)(const struct LedFade* fade, uint32_t i) {
+  return i < fade->count ? fade->steps[i] : fade->target;
+}
+
+/* The following function stops the fade of a slice and sets up one
+   from wherever its compare register is to cc, without starting it.
+   It returns false when there is nothing to stream, either because
+   the slice is at cc already or because cc holds a level with no
+   ramp, which is then written at once.  Merging the ramps of a slice
+   with two leds takes a few microseconds with interrupts disabled,
+   the rest takes a handful of register writes. */
+static bool RCLIGHTS_HOT_FUNC(setup_slice_fade)(uint slice, uint32_t cc) {
+  const uint chan = led_fade_chans[slice];
+
+  dma_channel_abort(chan);
+
+  const uint32_t current_cc = pwm_hw->slice[slice].cc;
+  struct LedFade fades[2] = { 0 }; // channel A and B
+  uint32_t count = 0;
+
+  for (int c = 0; c < 2; c++) {
+    const uint shift = c ? PWM_CH0_CC_B_LSB : PWM_CH0_CC_A_LSB;
+
+    if (!(led_fade_channels[slice] & (1 << c))) {
+      continue;
+    }
+
+    if (!find_led_fade((current_cc >> shift) & 0xffff, (cc >> shift) & 0xffff, &fades[c])) {
+      pwm_hw->slice[slice].cc = cc;
+      return false;
+    }
+
+    count = fades[c].count > count ? fades[c].count : count;
+  }
+
+  if (count == 0) {
+    return false;
+  }
+
+  dma_channel_config config = dma_channel_get_default_config(chan);
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, false);
+  channel_config_set_dreq(&config, pwm_get_dreq(slice));
+
+  const int buffer = led_fade_buffer_of_slice[slice];
+
+  if (buffer < 0) {
+    /* The bus writes a half word to both halves of the register, and
+       the half of the channel without a led does not matter. */
+    const struct LedFade* fade = &fades[led_fade_channels[slice] >> 1];
+
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    dma_channel_configure(chan, &config, &pwm_hw->slice[slice].cc, fade->steps, fade->count, false);
+  } else {
+    uint32_t* steps = led_fade_buffers[buffer];
+
+    for (uint32_t i = 0; i < count; i++) {
+      steps[i] = ((uint32_t)led_fade_step(&fades[0], i) << PWM_CH0_CC_A_LSB)
+        | ((uint32_t)led_fade_step(&fades[1], i) << PWM_CH0_CC_B_LSB);
+    }
+
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    dma_channel_configure(chan, &config, &pwm_hw->slice[slice].cc, steps, count, false);
+  }
+
+  return true;
+}
+
+#endif
+
+/* The led slices start on the same cycle with the same wrap, so
+   they all wrap together and commit_leds() can update them within
+   one period. */
+void init_leds() {
+  for (int i = 0; i < LED_COUNT; i++) {
+    init_led(&LEDS[i]);
+  }
+
+#if RCLIGHTS_LED_FADES
+  init_led_fades();
+#endif
+
+  for (uint slice = 0; slice < NUM_PWM_SLICES; slice++) {
+    if (led_slices_mask & (1u << slice)) {
+      pwm_hw->slice[slice].cc = committed_cc[slice];
+    }
+  }
+
+  pwm_set_mask_enabled(pwm_hw->en | led_slices_mask);
+}
+
+void RCLIGHTS_HOT_FUNC(set_led_level)(struct Led* led, uint16_t level) {
+  led->level = level;
+}
+
+#if RCLIGHTS_LED_FADES
+
+/* The following function fades the slices whose levels changed to
+   their new levels.  All fades start on the same call, so with the
+   slices wrapping together they step on the same wraps. */
+void RCLIGHTS_HOT_FUNC(commit_leds)() {
+  uint32_t cc[NUM_PWM_SLICES] = { 0 };
+
+  for (int i = 0; i < LED_COUNT; i++) {
+    const struct Led* led = &LEDS[i];
+
+    cc[led->pwm_slice] |= OUTPUT_PWM_COUNTS(led->level) << (led->pwm_chan == PWM_CHAN_B ? PWM_CH0_CC_B_LSB : PWM_CH0_CC_A_LSB);
+  }
+
+  uint32_t chan_mask = 0;
+
+  for (uint slice = 0; slice < NUM_PWM_SLICES; slice++) {
+    if (!(led_slices_mask & (1u << slice)) || cc[slice] == committed_cc[slice]) {
+      continue;
+    }
+
+    if (setup_slice_fade(slice, cc[slice])) {
+      chan_mask |= 1u << led_fade_chans[slice];
+    }
+
+    committed_cc[slice] = cc[slice];
+  }
+
+  dma_start_channel_mask(chan_mask);
+}
+
+#else
+
+/* The following function writes the levels of the leds to the slices
+   whose levels changed, one register write per slice.  The slices
+   latch new levels on their next wrap, so the writes go out right
+   after a wrap with interrupts disabled and all of them take effect
+   on the same wrap.  With the default wrap a period lasts at least a
+   hundred cycles, which is enough for the few writes of a frame. */
+void RCLIGHTS_HOT_FUNC(commit_leds)() {
+  uint32_t cc[NUM_PWM_SLICES] = { 0 };
+
+  for (int i = 0; i < LED_COUNT; i++) {
+    const struct Led* led = &LEDS[i];
+
+    cc[led->pwm_slice] |= (uint32_t)led->level << (led->pwm_chan == PWM_CHAN_B ? PWM_CH0_CC_B_LSB : PWM_CH0_CC_A_LSB);
+  }
+
+  uint32_t changed_mask = 0;
+
+  for (uint slice = 0; slice < NUM_PWM_SLICES; slice++) {
+    if (cc[slice] != committed_cc[slice]) {
+      changed_mask |= 1u << slice;
+    }
+  }
+
+  if (!changed_mask) {
+    return;
+  }
+
+  const uint sync_slice = LEDS[0].pwm_slice;
+  uint32_t interrupts = save_and_disable_interrupts();
+
+  pwm_clear_irq(sync_slice);
+  while (!(pwm_hw->intr & (1u << sync_slice))) {
+    tight_loop_contents();
+  }
+
+  for (uint slice = 0; slice < NUM_PWM_SLICES; slice++) {
+    if (changed_mask & (1u << slice)) {
+      pwm_hw->slice[slice].cc = cc[slice];
+    }
+  }
+
+  restore_interrupts(interrupts);
+
+  for (uint slice = 0; slice < NUM_PWM_SLICES; slice++) {
+    committed_cc[slice] = cc[slice];
+  }
+}
+
+#endif
+
+/* Blinking leds follow the phase of a blink group.  A repeating
+   timer of the SDK alarm pool toggles the phase of each group on a
+   fixed schedule, so leds of the same group blink together and
+   leds of different groups blink independently. */
+#define BLINK_GROUP_OF_PROFILE(name, interval) \
+  [name] = {                                   \
+    .interval_us = interval,                   \
+    .on = false,                               \
+  },
+
+struct BlinkGroup BLINK_GROUPS[BLINK_GROUP_COUNT] = {
+  PROFILE_BLINK_GROUPS(BLINK_GROUP_OF_PROFILE)
+};
+
+/* The following function returns a mask of the leds whose blink group
+   is in its lit phase. */
+uint8_t RCLIGHTS_HOT_FUNC(blink_lit_mask)() {
+  uint8_t mask = 0;
+
+  for (int g = 0; g < BLINK_GROUP_COUNT; g++) {
+    mask |= BLINK_GROUPS[g].leds_mask & -(uint8_t)BLINK_GROUPS[g].on;
+  }
+
+  return mask;
+}
+
+volatile uint8_t rendered_master_lights_state = 0;
+
+/* The following function applies a master lights state and commits
+   the leds.  The main loop renders when the state changes and the
+   blink timers render when a phase changes, so it runs with
+   interrupts disabled to keep one from interleaving with the other. */
+void RCLIGHTS_HOT_FUNC(render_master_lights_state)(uint8_t state) {
+  uint32_t interrupts = save_and_disable_interrupts();
+  const bool changed = state != rendered_master_lights_state;
+
+  uint16_t levels[LED_COUNT];
+
+  metrics_stage(METRICS_RULES);
+  rendered_master_lights_state = state;
+  apply_master_lights_state(state, blink_lit_mask(), levels);
+
+  metrics_stage(METRICS_OUTPUT);
+
+  for (int i = 0; i < LED_COUNT; i++) {
+    set_led_level(&LEDS[i], levels[i]);
+  }
+
+  commit_leds();
+  show_ws2812_levels(levels);
+
+  restore_interrupts(interrupts);
+
+  if (changed) {
+    latency_note_write();
+  }
+}
+
+/* Toggles the phase of a blink group exactly on its schedule and
+   renders the result right away. */
+static bool RCLIGHTS_HOT_FUNC(blink_group_timer_callback)(repeating_timer_t* timer) {
+  struct BlinkGroup* group = timer->user_data;
+
+  group->on = !group->on;
+  render_master_lights_state(rendered_master_lights_state);
+
+  return true;
+}
+
+void init_blink_groups() {
+  for (int i = 0; i < LED_COUNT; i++) {
+    if (LED_RULES[i].blink_bits) {
+      BLINK_GROUPS[LED_RULES[i].blink_group].leds_mask |= 1 << i;
+    }
+  }
+
+  for (int g = 0; g < BLINK_GROUP_COUNT; g++) {
+    struct BlinkGroup* group = &BLINK_GROUPS[g];
+
+    /* A negative delay keeps the time between toggles fixed no matter
+       how long the callback takes. */
+    add_repeating_timer_us(-(int64_t)group->interval_us, blink_group_timer_callback, group, &group->timer);
+  }
+}
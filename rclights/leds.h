@@ -0,0 +1,57 @@
+// ********************************************************************************
+// Data structure Led and corresponding operations that control leds
+// connected to GPIO pins.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_LEDS_H
+#define RCLIGHTS_LEDS_H
+
+#include "pico/stdlib.h"
+#include "light_rules.h"
+
+/* With RCLIGHTS_LED_FADES set to 1, leds ramp between levels the way
+   incandescent bulbs do instead of switching at once.  A DMA channel
+   per slice streams each ramp into the compare register, one step
+   per PWM period paced by the wrap DREQ of the slice, so a fade costs
+   no CPU once started. */
+#ifndef RCLIGHTS_LED_FADES
+#define RCLIGHTS_LED_FADES 0
+#endif
+
+/* The level of a led is the one the rules want.  It reaches the PWM
+   slice of the led on the next call to commit_leds(). */
+struct Led {
+  const uint id;
+  uint pwm_slice;
+  uint pwm_chan;
+  uint16_t level;
+};
+
+extern struct Led LEDS[LED_COUNT];
+
+/* Blinking leds follow the phase of a blink group.  A repeating
+   timer of the SDK alarm pool toggles the phase of each group on a
+   fixed schedule, so leds of the same group blink together and
+   leds of different groups blink independently. */
+struct BlinkGroup {
+  const uint32_t interval_us;
+  volatile bool on;
+  uint8_t leds_mask; // bit i set when LEDS[i] follows this group
+  repeating_timer_t timer;
+};
+
+extern struct BlinkGroup BLINK_GROUPS[BLINK_GROUP_COUNT];
+
+/* The master lights state last rendered. */
+extern volatile uint8_t rendered_master_lights_state;
+
+void init_leds();
+void set_led_level(struct Led* led, uint16_t level);
+void commit_leds();
+
+void init_blink_groups();
+uint8_t blink_lit_mask();
+
+void render_master_lights_state(uint8_t state);
+
+#endif
@@ -0,0 +1,67 @@
+// ********************************************************************************
+// Application of master light states to light sets.
+// ********************************************************************************
+
+#include "light_rules.h"
+#include "hot_path.h"
+
+#define LED_RULE_OF_PROFILE(arg, name, pin, base_, on_bits_, blink_bits_, hi_bits_, blink_group_) \
+  [name] = { .base = base_, .on_bits = on_bits_, .blink_bits = blink_bits_, .hi_bits = hi_bits_, .blink_group = blink_group_ },
+
+const struct LedRule LED_RULES[LED_COUNT] = {
+  PROFILE_LEDS(LED_RULE_OF_PROFILE, 0)
+};
+
+uint16_t led_state_level(enum LedState state) {
+  switch(state) {
+  case ON:
+    return OUTPUT_PWM_ON_LEVEL;
+  case HI:
+    return OUTPUT_PWM_HI_LEVEL;
+  default:
+    return OUTPUT_PWM_OFF_LEVEL;
+  }
+}
+
+/* The state of a led under its rule in a master lights state and the
+   level of a led state, as constant expressions. */
+#define LED_RULE_STATE(state, base, on_bits, blink_bits, hi_bits) \
+  ((state) & (hi_bits) ? HI : (state) & ((blink_bits) | (on_bits)) ? ON : (base))
+#define LED_STATE_LEVEL(led_state) \
+  ((led_state) == HI ? PROFILE_HI_LEVEL : (led_state) == ON ? PROFILE_ON_LEVEL : 0)
+
+#define ENTRY_LEVEL_OF_PROFILE(state, name, pin, base, on_bits, blink_bits, hi_bits, blink_group) \
+  [name] = LED_STATE_LEVEL(LED_RULE_STATE(state, base, on_bits, blink_bits, hi_bits)),
+#define ENTRY_BLINK_OF_PROFILE(state, name, pin, base, on_bits, blink_bits, hi_bits, blink_group) \
+  | (!((state) & (hi_bits)) && ((state) & (blink_bits)) ? 1 << (name) : 0)
+
+/* A led blinks when a blink bit is set and no hi bit is. */
+#define MASTER_LIGHTS_ENTRY(state) { \
+    .levels = { PROFILE_LEDS(ENTRY_LEVEL_OF_PROFILE, state) }, \
+    .blink_mask = 0 PROFILE_LEDS(ENTRY_BLINK_OF_PROFILE, state), \
+  }
+
+#define MASTER_LIGHTS_ENTRIES_4(s)  MASTER_LIGHTS_ENTRY(s), MASTER_LIGHTS_ENTRY((s) + 1), \
+                                    MASTER_LIGHTS_ENTRY((s) + 2), MASTER_LIGHTS_ENTRY((s) + 3)
+#define MASTER_LIGHTS_ENTRIES_16(s) MASTER_LIGHTS_ENTRIES_4(s), MASTER_LIGHTS_ENTRIES_4((s) + 4), \
+                                    MASTER_LIGHTS_ENTRIES_4((s) + 8), MASTER_LIGHTS_ENTRIES_4((s) + 12)
+#define MASTER_LIGHTS_ENTRIES_64(s) MASTER_LIGHTS_ENTRIES_16(s), MASTER_LIGHTS_ENTRIES_16((s) + 16), \
+                                    MASTER_LIGHTS_ENTRIES_16((s) + 32), MASTER_LIGHTS_ENTRIES_16((s) + 48)
+
+_Static_assert(MASTER_LIGHTS_STATES == 64, "master lights entries are generated for 64 states");
+
+struct MasterLightsEntry master_lights_entries[MASTER_LIGHTS_STATES] = { MASTER_LIGHTS_ENTRIES_64(0) };
+
+/* The following function applies a master lights state in a single
+   pass over the leds.  The blink mask only decides which leds go dark
+   during the off phase of their blink group. */
+void RCLIGHTS_HOT_FUNC(apply_master_lights_state)(uint8_t state, uint8_t lit_mask, uint16_t levels[LED_COUNT]) {
+  const struct MasterLightsEntry* entry = &master_lights_entries[state & (MASTER_LIGHTS_STATES - 1)];
+  const uint8_t dark_mask = entry->blink_mask & ~lit_mask;
+
+  for (int i = 0; i < LED_COUNT; i++) {
+    uint16_t lit = ((dark_mask >> i) & 1) ^ 1;
+
+    levels[i] = entry->levels[i] * lit;
+  }
+}
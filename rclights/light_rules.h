@@ -0,0 +1,74 @@
+// ********************************************************************************
+// Application of master light states to light sets.
+//
+// Light sets introduced in the blog post do not correspond to a
+// concrete data structure, rather they are modelled by the rules in
+// this module.  Each rule tells which bits of the master lights state
+// turn its led hi, blink it or turn it on.  The leds, their rules and
+// the bits come from the vehicle profile, see vehicle_profile.h, and
+// the compiler expands them into a table with the level of every led
+// and the leds that blink, for each of the master lights states.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_LIGHT_RULES_H
+#define RCLIGHTS_LIGHT_RULES_H
+
+#include <stdint.h>
+#include "vehicle_profile.h"
+
+static const uint16_t OUTPUT_PWM_MAX_LEVEL = 100;
+static const uint16_t OUTPUT_PWM_ON_LEVEL = PROFILE_ON_LEVEL;
+static const uint16_t OUTPUT_PWM_OFF_LEVEL = 0;
+static const uint16_t OUTPUT_PWM_HI_LEVEL = PROFILE_HI_LEVEL;
+
+enum LedState {
+  OFF,
+  ON,
+  HI,
+  LED_STATE_COUNT,
+};
+
+#define LED_INDEX_OF_PROFILE(arg, name, pin, base, on_bits, blink_bits, hi_bits, blink_group) name,
+
+enum LedIndex {
+  PROFILE_LEDS(LED_INDEX_OF_PROFILE, 0)
+  LED_COUNT,
+};
+
+_Static_assert(LED_COUNT <= 8, "profile leds must fit the 8 bit led masks");
+
+#define BLINK_GROUP_INDEX_OF_PROFILE(name, interval_us) name,
+
+enum BlinkGroupIndex {
+  PROFILE_BLINK_GROUPS(BLINK_GROUP_INDEX_OF_PROFILE)
+  BLINK_GROUP_COUNT,
+};
+
+#define MASTER_LIGHTS_STATES 64 // every combination of the bits of the profile
+
+struct LedRule {
+  enum LedState base; // state of the led when none of the bits below is set
+  uint8_t on_bits;    // any of these bits turns the led on
+  uint8_t blink_bits; // any of these bits blinks the led, overrides on_bits
+  uint8_t hi_bits;    // any of these bits turns the led hi, overrides blink_bits and on_bits
+  enum BlinkGroupIndex blink_group; // phase followed when blinking
+};
+
+extern const struct LedRule LED_RULES[LED_COUNT];
+
+struct MasterLightsEntry {
+  uint16_t levels[LED_COUNT]; // level of each led, blinking leds have their lit level
+  uint8_t blink_mask;         // bit i set when led i blinks
+};
+
+/* Not const so that it lives in RAM. */
+extern struct MasterLightsEntry master_lights_entries[MASTER_LIGHTS_STATES];
+
+uint16_t led_state_level(enum LedState state);
+
+/* Computes the level of every led for a master lights state.  Bit i
+   of lit_mask tells whether the blink group of led i is in its lit
+   phase. */
+void apply_master_lights_state(uint8_t state, uint8_t lit_mask, uint16_t levels[LED_COUNT]);
+
+#endif
@@ -0,0 +1,155 @@
+// ********************************************************************************
+// Conversion of input PWM to master light states
+// ********************************************************************************
+
+#include "master_state.h"
+#include "hot_path.h"
+
+struct InputPwmRange input_pwm_range = {
+  .min_us = INPUT_PWM_US_RANGE_MIN,
+  .max_us = INPUT_PWM_US_RANGE_MAX,
+  .size_us = INPUT_PWM_US_RANGE_SIZE,
+  .half_bucket = HI_US(INPUT_PWM_US_RANGE_SIZE) / (2 * (MASTER_LIGHT_STATE_COUNT - 1)),
+};
+
+#if INPUT_PWM_FLOAT
+static float input_pwm_us_bucket_size = (float)INPUT_PWM_US_RANGE_SIZE / (MASTER_LIGHT_STATE_COUNT - 1);
+#endif
+
+uint8_t RCLIGHTS_HOT_FUNC(input_pwm_hi_us_to_master_state_id)(hi_us_t hi_us) {
+  /* ******************************************************************************** */
+  /* Iterative way for debugging purposes.*/
+  /* uint8_t state_id = 0; */
+  /* float current_threshold = INPUT_PWM_US_RANGE_MIN + INPUT_PWM_US_BUCKET_SIZE / 2; */
+
+  /* while(current_threshold < hi_us) { */
+  /*   state_id++; */
+  /*   current_threshold += INPUT_PWM_US_BUCKET_SIZE; */
+  /* } */
+
+  /* printf("current_threshold = %f\n", current_threshold); */
+
+  /* return state_id; */
+  /* ******************************************************************************** */
+
+#if INPUT_PWM_FLOAT
+  /* Clamped to the ids before the conversion, which is undefined for
+     a float out of the range of uint8_t. */
+  const float state_id = (hi_us - input_pwm_range.min_us + input_pwm_us_bucket_size / 2) / input_pwm_us_bucket_size;
+
+  if (!(state_id > 0)) { // NaN included
+    return 0;
+  }
+
+  return state_id < MASTER_LIGHT_STATE_COUNT - 1 ? (uint8_t)state_id : MASTER_LIGHT_STATE_COUNT - 1;
+#else
+  /* Same rounding as the float version with both sides of the
+     division multiplied by 2 * input_pwm_range.size_us, so that the
+     bucket size never needs to be represented. */
+  return (2 * (hi_us - HI_US(input_pwm_range.min_us)) * (MASTER_LIGHT_STATE_COUNT - 1) + HI_US(input_pwm_range.size_us))
+    / (2 * HI_US(input_pwm_range.size_us));
+#endif
+}
+
+hi_us_t RCLIGHTS_HOT_FUNC(master_state_id_to_hi_us)(uint8_t state_id) {
+#if INPUT_PWM_FLOAT
+  return input_pwm_range.min_us + state_id * input_pwm_us_bucket_size;
+#else
+  return HI_US(input_pwm_range.min_us)
+    + (state_id * HI_US(input_pwm_range.size_us) + (MASTER_LIGHT_STATE_COUNT - 1) / 2) / (MASTER_LIGHT_STATE_COUNT - 1);
+#endif
+}
+
+#if !INPUT_PWM_FLOAT
+/* Lookup table from the microsecond offset of a width from
+   INPUT_PWM_US_RANGE_MIN to its master lights state.  The compiler
+   evaluates every entry from the range constants, with the same
+   rounding as input_pwm_hi_us_to_master_state_id().  Offsets past the
+   range, starting with the one at index INPUT_PWM_US_RANGE_SIZE, hold
+   the off state.  The table is not const so it lives in RAM. */
+_Static_assert(INPUT_PWM_US_RANGE_SIZE < MASTER_LIGHTS_TABLE_SIZE, "master lights table too small for the input range");
+
+#define MASTER_STATE_ID_OF_US_OFFSET(offset) \
+  ((2 * (offset) * (MASTER_LIGHT_STATE_COUNT - 1) + INPUT_PWM_US_RANGE_SIZE) / (2 * INPUT_PWM_US_RANGE_SIZE))
+#define MASTER_LIGHTS_TABLE_ENTRY(offset) \
+  ((offset) < INPUT_PWM_US_RANGE_SIZE ? MASTER_LIGHTS_STATE_OF_ID(MASTER_STATE_ID_OF_US_OFFSET(offset)) : MASTER_LIGHTS_OFF_STATE)
+
+#define MASTER_LIGHTS_TABLE_4(o)    MASTER_LIGHTS_TABLE_ENTRY(o), MASTER_LIGHTS_TABLE_ENTRY((o) + 1), \
+                                    MASTER_LIGHTS_TABLE_ENTRY((o) + 2), MASTER_LIGHTS_TABLE_ENTRY((o) + 3)
+#define MASTER_LIGHTS_TABLE_16(o)   MASTER_LIGHTS_TABLE_4(o), MASTER_LIGHTS_TABLE_4((o) + 4), \
+                                    MASTER_LIGHTS_TABLE_4((o) + 8), MASTER_LIGHTS_TABLE_4((o) + 12)
+#define MASTER_LIGHTS_TABLE_64(o)   MASTER_LIGHTS_TABLE_16(o), MASTER_LIGHTS_TABLE_16((o) + 16), \
+                                    MASTER_LIGHTS_TABLE_16((o) + 32), MASTER_LIGHTS_TABLE_16((o) + 48)
+#define MASTER_LIGHTS_TABLE_256(o)  MASTER_LIGHTS_TABLE_64(o), MASTER_LIGHTS_TABLE_64((o) + 64), \
+                                    MASTER_LIGHTS_TABLE_64((o) + 128), MASTER_LIGHTS_TABLE_64((o) + 192)
+#define MASTER_LIGHTS_TABLE_1024(o) MASTER_LIGHTS_TABLE_256(o), MASTER_LIGHTS_TABLE_256((o) + 256), \
+                                    MASTER_LIGHTS_TABLE_256((o) + 512), MASTER_LIGHTS_TABLE_256((o) + 768)
+
+uint8_t master_lights_table[MASTER_LIGHTS_TABLE_SIZE] = { MASTER_LIGHTS_TABLE_1024(0) };
+#endif
+
+#if INPUT_PWM_FLOAT
+/* Widths outside of the range, after rounding to the whole
+   microsecond as in the fixed point version, decode to the off
+   state like the off entry of its table. */
+uint8_t RCLIGHTS_HOT_FUNC(input_pwm_hi_us_to_master_lights_state)(hi_us_t hi_us) {
+  const float offset = hi_us - input_pwm_range.min_us + 0.5f;
+
+  if (!(offset >= 0 && offset < input_pwm_range.size_us)) { // NaN included
+    return MASTER_LIGHTS_OFF_STATE;
+  }
+
+  uint8_t state_id = input_pwm_hi_us_to_master_state_id(hi_us);
+
+  /* printf("state_id = %d\n", state_id); */
+
+  uint8_t state = MASTER_LIGHTS_STATE_OF_ID(state_id);
+
+  return state;
+}
+#else
+/* The following function returns the entry of the lookup table for
+   the whole microsecond nearest to hi_us.  Widths outside of the
+   range land on the off entry at the end of the table. */
+uint8_t RCLIGHTS_HOT_FUNC(input_pwm_hi_us_to_master_lights_state)(hi_us_t hi_us) {
+  uint32_t offset = ((hi_us + HI_US(1) / 2) >> HI_US_FRAC_BITS) - input_pwm_range.min_us;
+
+  if (offset > input_pwm_range.size_us) { // negative offsets wrap to large values
+    offset = input_pwm_range.size_us;
+  }
+
+  return master_lights_table[offset];
+}
+#endif
+
+bool RCLIGHTS_HOT_FUNC(input_pwm_hi_us_in_range)(hi_us_t hi_us) {
+  return hi_us >= HI_US(input_pwm_range.min_us) && hi_us <= HI_US(input_pwm_range.max_us);
+}
+
+bool input_pwm_us_range_valid(uint16_t min_us, uint16_t max_us, uint16_t min_bucket_us) {
+  return min_us < max_us
+    && max_us - min_us + 1 < MASTER_LIGHTS_TABLE_SIZE
+    && max_us - min_us + 1 >= min_bucket_us * (MASTER_LIGHT_STATE_COUNT - 1);
+}
+
+/* The following function fills the lookup table with the same
+   entries MASTER_LIGHTS_TABLE_ENTRY() gives at compile time for the
+   default range. */
+void set_input_pwm_us_range(uint16_t min_us, uint16_t max_us) {
+  const uint32_t size_us = max_us - min_us + 1;
+
+  input_pwm_range.min_us = min_us;
+  input_pwm_range.max_us = max_us;
+  input_pwm_range.size_us = size_us;
+  input_pwm_range.half_bucket = HI_US(size_us) / (2 * (MASTER_LIGHT_STATE_COUNT - 1));
+
+#if INPUT_PWM_FLOAT
+  input_pwm_us_bucket_size = (float)size_us / (MASTER_LIGHT_STATE_COUNT - 1);
+#else
+  for (uint32_t offset = 0; offset < MASTER_LIGHTS_TABLE_SIZE; offset++) {
+    master_lights_table[offset] = offset < size_us
+      ? MASTER_LIGHTS_STATE_OF_ID((2 * offset * (MASTER_LIGHT_STATE_COUNT - 1) + size_us) / (2 * size_us))
+      : MASTER_LIGHTS_OFF_STATE;
+  }
+#endif
+}
@@ -0,0 +1,87 @@
+// ********************************************************************************
+// Conversion of input PWM to master light states
+// ********************************************************************************
+
+#ifndef RCLIGHTS_MASTER_STATE_H
+#define RCLIGHTS_MASTER_STATE_H
+
+#include "input_pwm.h"
+
+/* These are macros rather than constants so that the lookup table
+   in master_state.c can be generated from them at compile time.  They
+   are the range until set_input_pwm_us_range() replaces it, as the
+   firmware does at boot with a calibrated range, see calibration.h. */
+#define INPUT_PWM_US_RANGE_MIN 1019 // You might need to adjust these to match the MIN microseconds duty cycle for your transmitter/receiver combination
+#define INPUT_PWM_US_RANGE_MAX 1981 // Similar warning as that of INPUT_PWM_US_RANGE_MIN
+#define INPUT_PWM_US_RANGE_SIZE (INPUT_PWM_US_RANGE_MAX - INPUT_PWM_US_RANGE_MIN + 1)
+#define MASTER_LIGHT_STATE_COUNT 48
+
+/* Layouts of the master lights states over the state ids.  Every id
+   holds one of three brake and reverse settings in bits 0 and 1 and
+   one of the 16 combinations of bits 2 to 5.  The packed layout
+   counts through them in binary, so neighbouring ids may differ in
+   several light functions at once.  The gray layout walks the brake
+   and reverse settings as brake, none, reverse, back and forth, and
+   the other bits in Gray code, so neighbouring ids always differ in
+   one light function and a reading off by one bucket only shows as
+   that function.  See MIX_TABLES.md for the widths a transmitter
+   mix should send. */
+#define MASTER_STATE_LAYOUT_PACKED 0
+#define MASTER_STATE_LAYOUT_GRAY 1
+
+#ifndef MASTER_STATE_LAYOUT
+#define MASTER_STATE_LAYOUT MASTER_STATE_LAYOUT_PACKED
+#endif
+
+#if MASTER_STATE_LAYOUT == MASTER_STATE_LAYOUT_PACKED
+#define MASTER_LIGHTS_STATE_OF_ID(id) (((id) % 3) + (((id) / 3) << 2))
+#elif MASTER_STATE_LAYOUT == MASTER_STATE_LAYOUT_GRAY
+#define MASTER_STATE_GRAY_GROUP(id) ((id) / 3)
+#define MASTER_STATE_GRAY_STEP(id) (MASTER_STATE_GRAY_GROUP(id) & 1 ? 2 - (id) % 3 : (id) % 3)
+#define MASTER_STATE_GRAY_LOW_BITS(step) ((step) == 0 ? 1 : (step) == 1 ? 0 : 2) // brake, none, reverse
+#define MASTER_LIGHTS_STATE_OF_ID(id) \
+  (MASTER_STATE_GRAY_LOW_BITS(MASTER_STATE_GRAY_STEP(id)) \
+   | ((MASTER_STATE_GRAY_GROUP(id) ^ (MASTER_STATE_GRAY_GROUP(id) >> 1)) << 2))
+#else
+#error "Unknown MASTER_STATE_LAYOUT"
+#endif
+
+#define MASTER_LIGHTS_OFF_STATE 0 // all lights off, for widths out of the range and before the first frame
+
+#define MASTER_LIGHTS_TABLE_SIZE 1024
+
+#if !INPUT_PWM_FLOAT
+extern uint8_t master_lights_table[MASTER_LIGHTS_TABLE_SIZE];
+#endif
+
+/* The range of widths the buckets span and what is derived from it. */
+struct InputPwmRange {
+  uint16_t min_us;
+  uint16_t max_us;
+  uint16_t size_us;        // max_us - min_us + 1
+  hi_us_t half_bucket;     // half the width of a bucket
+};
+
+extern struct InputPwmRange input_pwm_range;
+
+/* Checks that a range leaves every bucket at least min_bucket_us wide
+   and fits the lookup table. */
+bool input_pwm_us_range_valid(uint16_t min_us, uint16_t max_us, uint16_t min_bucket_us);
+
+/* True when hi_us lies within the range, so that it decodes to a
+   state of its bucket rather than to the off entry. */
+bool input_pwm_hi_us_in_range(hi_us_t hi_us);
+
+/* Replaces the range and regenerates the lookup table for it, so the
+   decoder costs the same per frame whatever the range.  Takes a few
+   thousand cycles; meant for boot. */
+void set_input_pwm_us_range(uint16_t min_us, uint16_t max_us);
+
+uint8_t input_pwm_hi_us_to_master_state_id(hi_us_t hi_us);
+
+/* Width at the centre of the bucket of state_id. */
+hi_us_t master_state_id_to_hi_us(uint8_t state_id);
+
+uint8_t input_pwm_hi_us_to_master_lights_state(hi_us_t hi_us);
+
+#endif
@@ -0,0 +1,161 @@
+// ********************************************************************************
+// Loop metrics
+// ********************************************************************************
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
+#include "metrics.h"
+#include "sys_clock.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_METRICS
+
+#define METRICS_SYSTICK_MASK 0xffffff // SysTick counts down from here
+#define METRICS_WINDOW_US 1000000
+
+volatile struct Metrics rclights_metrics = {
+  .magic = METRICS_MAGIC,
+  .sys_clk_khz = SYS_CLK_KHZ,
+};
+
+/* Counts of the iteration and of the window in progress, each only
+   touched by its core.  Between two publications, windows are at
+   least METRICS_WINDOW_US long. */
+struct MetricsCounts {
+  enum MetricsStage stage;
+  uint32_t mark;
+  uint32_t iteration_start_us;
+  uint32_t window_start_us;
+  uint32_t window_iterations;
+  uint32_t iteration_cycles[METRICS_STAGE_COUNT];
+  uint32_t window_cycles[METRICS_STAGE_COUNT];
+};
+
+static struct MetricsCounts metrics_counts[METRICS_CORES];
+
+static inline uint32_t metrics_systick() {
+  return systick_hw->cvr;
+}
+
+void init_metrics() {
+  struct MetricsCounts* counts = &metrics_counts[get_core_num()];
+
+  systick_hw->rvr = METRICS_SYSTICK_MASK;
+  systick_hw->cvr = 0;
+  systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS; // system clock, no interrupt
+
+  memset(counts, 0, sizeof(*counts));
+  counts->stage = METRICS_OTHER;
+  counts->mark = metrics_systick();
+  counts->iteration_start_us = time_us_32();
+  counts->window_start_us = counts->iteration_start_us;
+}
+
+void RCLIGHTS_HOT_FUNC(metrics_stage)(enum MetricsStage stage) {
+  if (__get_current_exception()) {
+    return;
+  }
+
+  struct MetricsCounts* counts = &metrics_counts[get_core_num()];
+  const uint32_t now = metrics_systick();
+
+  counts->iteration_cycles[counts->stage] += (counts->mark - now) & METRICS_SYSTICK_MASK;
+  counts->stage = stage;
+  counts->mark = now;
+}
+
+/* The following function publishes the window that just ended,
+   scaled to a second, and starts the next one. */
+static void publish_metrics_window(uint32_t core, struct MetricsCounts* counts, uint32_t now_us) {
+  volatile struct MetricsCore* published = &rclights_metrics.cores[core];
+  const uint32_t window_us = now_us - counts->window_start_us;
+
+  published->sequence++;
+  __dmb();
+
+  published->iterations_per_sec = (uint64_t)counts->window_iterations * METRICS_WINDOW_US / window_us;
+
+  for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+    published->stage_cycles_per_sec[s] = (uint64_t)counts->window_cycles[s] * METRICS_WINDOW_US / window_us;
+    counts->window_cycles[s] = 0;
+  }
+
+  counts->window_iterations = 0;
+  counts->window_start_us = now_us;
+  published->seconds++;
+
+  __dmb();
+  published->sequence++;
+}
+
+void RCLIGHTS_HOT_FUNC(metrics_loop)() {
+  const uint32_t core = get_core_num();
+  struct MetricsCounts* counts = &metrics_counts[core];
+  volatile struct MetricsCore* published = &rclights_metrics.cores[core];
+
+  metrics_stage(counts->stage); // charges the cycles up to here
+
+  const uint32_t now_us = time_us_32();
+  const uint32_t iteration_us = now_us - counts->iteration_start_us;
+  uint32_t busy_cycles = 0;
+
+  /* The maxima since boot only grow, so the few readers that see one
+     before the rest of a publication see nothing inconsistent. */
+  for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+    const uint32_t cycles = counts->iteration_cycles[s];
+
+    if (cycles > published->stage_cycles_max[s]) {
+      published->stage_cycles_max[s] = cycles;
+    }
+
+    if (s != METRICS_CAPTURE_WAIT) {
+      busy_cycles += cycles;
+    }
+
+    counts->window_cycles[s] += cycles;
+    counts->iteration_cycles[s] = 0;
+  }
+
+  if (busy_cycles > published->busy_cycles_max) {
+    published->busy_cycles_max = busy_cycles;
+  }
+
+  if (iteration_us > published->iteration_us_max) {
+    published->iteration_us_max = iteration_us;
+  }
+
+  published->iterations++;
+  counts->window_iterations++;
+  counts->iteration_start_us = now_us;
+
+  if (now_us - counts->window_start_us >= METRICS_WINDOW_US) {
+    publish_metrics_window(core, counts, now_us);
+  }
+}
+
+bool metrics_copy_core(uint32_t core, struct MetricsCore* copy) {
+  const volatile struct MetricsCore* published = &rclights_metrics.cores[core];
+  const uint32_t sequence = published->sequence;
+
+  __dmb();
+
+  copy->sequence = sequence;
+  copy->seconds = published->seconds;
+  copy->iterations = published->iterations;
+  copy->iterations_per_sec = published->iterations_per_sec;
+  copy->iteration_us_max = published->iteration_us_max;
+  copy->busy_cycles_max = published->busy_cycles_max;
+
+  for (int s = 0; s < METRICS_STAGE_COUNT; s++) {
+    copy->stage_cycles_per_sec[s] = published->stage_cycles_per_sec[s];
+    copy->stage_cycles_max[s] = published->stage_cycles_max[s];
+  }
+
+  __dmb();
+
+  return !(sequence & 1) && published->sequence == sequence;
+}
+
+#endif
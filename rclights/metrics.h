@@ -0,0 +1,89 @@
+// ********************************************************************************
+// Loop metrics
+//
+// With RCLIGHTS_METRICS set to 1, each core that runs a main loop
+// counts the system clock cycles it spends in every stage of an
+// iteration on its SysTick timer, along with the loop rate and the
+// worst iterations since boot.  The loops mark where each stage
+// starts with metrics_stage(); every cycle between two marks goes to
+// the stage of the first, so the stages of an iteration add up to
+// all of it.  Interrupt handlers count toward the stage they
+// interrupt.
+//
+// Once a second the counts are published to rclights_metrics, a
+// block of RAM at a fixed symbol that a debugger reads over SWD
+// without halting the core, and telemetry sends it as a record.
+// SysTick counts 24 bits, so a single stage longer than 2^24 cycles,
+// 134 ms at 125 MHz, is counted modulo that.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_METRICS_H
+#define RCLIGHTS_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef RCLIGHTS_METRICS
+#define RCLIGHTS_METRICS 0
+#endif
+
+#define METRICS_MAGIC 0x52434d31 // "RCM1"
+#define METRICS_CORES 2
+
+enum MetricsStage {
+  METRICS_CAPTURE_WAIT, // sleeping until the input is ready and blocking measurements; on core 0 of dual core builds, waiting for a new state
+  METRICS_FILTER,
+  METRICS_DECODE,       // state decoding, channel mapping, boot and failsafe states
+  METRICS_RULES,        // light rules
+  METRICS_OUTPUT,       // led, strip and sequencer writes
+  METRICS_OTHER,        // stdio, telemetry, trace and watchdog
+  METRICS_STAGE_COUNT,
+};
+
+struct MetricsCore {
+  uint32_t sequence;           // odd while a publication is being written
+  uint32_t seconds;            // publications since boot
+  uint32_t iterations;         // since boot
+  uint32_t iterations_per_sec;
+  uint32_t iteration_us_max;   // since boot, waits included
+  uint32_t busy_cycles_max;    // since boot, of the stages but METRICS_CAPTURE_WAIT
+  uint32_t stage_cycles_per_sec[METRICS_STAGE_COUNT];
+  uint32_t stage_cycles_max[METRICS_STAGE_COUNT]; // since boot, within one iteration
+};
+
+struct Metrics {
+  uint32_t magic;              // METRICS_MAGIC, for finding the block in a RAM dump
+  uint32_t sys_clk_khz;        // cycles per millisecond
+  struct MetricsCore cores[METRICS_CORES]; // indexed by core number, zero for a core without a loop
+};
+
+#if RCLIGHTS_METRICS
+
+extern volatile struct Metrics rclights_metrics;
+
+/* Starts SysTick and the counts of the calling core.  Called by each
+   core right before its main loop. */
+void init_metrics();
+
+/* Charges the cycles since the last mark of the calling core to the
+   stage of that mark and starts stage.  Ignored in interrupt
+   handlers. */
+void metrics_stage(enum MetricsStage stage);
+
+/* Ends an iteration of the main loop of the calling core, and
+   publishes its counts when a second has passed. */
+void metrics_loop();
+
+/* Copies the published counts of core.  Returns false when they were
+   being published meanwhile; a later call gets them. */
+bool metrics_copy_core(uint32_t core, struct MetricsCore* copy);
+
+#else
+
+static inline void init_metrics() {}
+static inline void metrics_stage(enum MetricsStage stage) {}
+static inline void metrics_loop() {}
+
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+// ********************************************************************************
+// Vehicle profile of the car in the blog post: headlights with high
+// beams, a blue front light, blinkers, brake and tail lights and a
+// reversing light.  See vehicle_profile.h.
+// ********************************************************************************
+
+#define BRAKE_LIGHT_BIT   (1 << 0)
+#define REVERSE_LIGHT_BIT (1 << 1)
+#define LEFT_BLINK_BIT    (1 << 2) // the blink bits together mean hazard
+#define RIGHT_BLINK_BIT   (1 << 3)
+#define HI_BEAMS_BIT      (1 << 4)
+#define DAY_NIGHT_BIT     (1 << 5)
+
+#define PROFILE_ON_LEVEL 20
+#define PROFILE_HI_LEVEL 100
+
+/* Left and right blinkers share a phase so that hazards blink
+   together. */
+#define PROFILE_BLINK_GROUPS(GROUP) \
+  GROUP(TURN_SIGNALS, 400000)
+
+#define PROFILE_LEDS(LED, arg) \
+  /*  arg  name            pin base on_bits            blink_bits       hi_bits          blink_group */ \
+  LED(arg, FRONT_WHITE,    17, OFF, DAY_NIGHT_BIT,     0,               HI_BEAMS_BIT,    TURN_SIGNALS) \
+  LED(arg, FRONT_BLUE,     18, ON,  0,                 0,               0,               TURN_SIGNALS) \
+  LED(arg, LEFT_BLINKERS,  20, OFF, 0,                 LEFT_BLINK_BIT,  0,               TURN_SIGNALS) \
+  LED(arg, RIGHT_BLINKERS, 21, OFF, 0,                 RIGHT_BLINK_BIT, 0,               TURN_SIGNALS) \
+  LED(arg, STOP,           22, OFF, DAY_NIGHT_BIT,     0,               BRAKE_LIGHT_BIT, TURN_SIGNALS) \
+  LED(arg, REVERSE,        28, OFF, REVERSE_LIGHT_BIT, 0,               0,               TURN_SIGNALS)
+
+/* Sequential turn signals on GPIO 10 to 12 and 13 to 15, and roof
+   strobes on GPIO 6 and 7 that alternate while the hazards are on. */
+#define PROFILE_SEQUENCER_GROUPS(GROUP, RULE) \
+  /*    name              base_pin pin_count rules */ \
+  GROUP(LEFT_SEQUENTIAL,  10,      3,        RULE(LEFT_BLINK_BIT, SEQUENTIAL)) \
+  GROUP(RIGHT_SEQUENTIAL, 13,      3,        RULE(RIGHT_BLINK_BIT, SEQUENTIAL)) \
+  GROUP(ROOF_STROBES,      6,      2,        RULE(LEFT_BLINK_BIT | RIGHT_BLINK_BIT, STROBE))
+
+/* A strip along the car on GPIO 2, front to back and around: the
+   blinkers at both ends. */
+#define PROFILE_WS2812_PIN 2
+#define PROFILE_PIXEL_COUNT 20
+
+#define PROFILE_PIXEL_RANGES(RANGE) \
+  RANGE(LEFT_BLINKERS,   0, 2, 0xff8000) \
+  RANGE(FRONT_WHITE,     2, 4, 0xffffff) \
+  RANGE(FRONT_BLUE,      6, 2, 0x0000ff) \
+  RANGE(RIGHT_BLINKERS,  8, 2, 0xff8000) \
+  RANGE(RIGHT_BLINKERS, 10, 2, 0xff8000) \
+  RANGE(STOP,           12, 3, 0xff0000) \
+  RANGE(REVERSE,        15, 2, 0xffffff) \
+  RANGE(STOP,           17, 1, 0xff0000) \
+  RANGE(LEFT_BLINKERS,  18, 2, 0xff8000)
+
+/* You might need to adjust the channel rules to the channels and
+   switches of your transmitter.  Channel numbers in the comments are
+   one-based, as transmitters show them. */
+#define PROFILE_RC_CHANNEL_RULES(RULE) \
+  /*   bits                               channel min_us max_us */ \
+  RULE(BRAKE_LIGHT_BIT,                   1,      1300,  1460) /* channel 2, throttle: a little below neutral brakes */ \
+  RULE(REVERSE_LIGHT_BIT,                 1,       900,  1299) /* further below neutral reverses */ \
+  RULE(LEFT_BLINK_BIT,                    4,       900,  1250) /* channel 5, three position switch: left, off, right */ \
+  RULE(RIGHT_BLINK_BIT,                   4,      1750,  2100) \
+  RULE(LEFT_BLINK_BIT | RIGHT_BLINK_BIT,  6,      1500,  2100) /* channel 7, two position switch: hazards */ \
+  RULE(DAY_NIGHT_BIT,                     7,      1250,  2100) /* channel 8, three position switch: off, lights, hi beams */ \
+  RULE(HI_BEAMS_BIT,                      7,      1750,  2100)
+
+#define PROFILE_RC_SERVO_CHANNEL_RULES(RULE) \
+  /*   bits                               channel min_us max_us */ \
+  RULE(BRAKE_LIGHT_BIT,                   0,      1300,  1460) /* first pin, throttle: a little below neutral brakes */ \
+  RULE(REVERSE_LIGHT_BIT,                 0,       900,  1299) /* further below neutral reverses */ \
+  RULE(LEFT_BLINK_BIT,                    1,       900,  1250) /* second pin, three position switch: left, off, right */ \
+  RULE(RIGHT_BLINK_BIT,                   1,      1750,  2100) \
+  RULE(DAY_NIGHT_BIT,                     2,      1250,  2100) /* third pin, three position switch: off, lights, hi beams */ \
+  RULE(HI_BEAMS_BIT,                      2,      1750,  2100) \
+  RULE(LEFT_BLINK_BIT | RIGHT_BLINK_BIT,  3,      1500,  2100) /* fourth pin, two position switch: hazards */
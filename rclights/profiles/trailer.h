@@ -0,0 +1,73 @@
+// ********************************************************************************
+// Vehicle profile of a trailer: rear lights only, plus side markers
+// that flash as a reversing warning on a phase of their own.  Fed the
+// same channel as the towing car.  See vehicle_profile.h.
+// ********************************************************************************
+
+#define BRAKE_LIGHT_BIT   (1 << 0)
+#define REVERSE_LIGHT_BIT (1 << 1)
+#define LEFT_BLINK_BIT    (1 << 2) // the blink bits together mean hazard
+#define RIGHT_BLINK_BIT   (1 << 3)
+#define HI_BEAMS_BIT      (1 << 4) // unused, a trailer has no headlights
+#define DAY_NIGHT_BIT     (1 << 5)
+
+#define PROFILE_ON_LEVEL 30
+#define PROFILE_HI_LEVEL 100
+
+/* The blinkers keep the phase of those of the car, the markers flash
+   faster, independently. */
+#define PROFILE_BLINK_GROUPS(GROUP) \
+  GROUP(TURN_SIGNALS, 400000) \
+  GROUP(REVERSE_WARNING, 250000)
+
+#define PROFILE_LEDS(LED, arg) \
+  /*  arg  name            pin base on_bits            blink_bits         hi_bits          blink_group */ \
+  LED(arg, LEFT_BLINKERS,  17, OFF, 0,                 LEFT_BLINK_BIT,    0,               TURN_SIGNALS) \
+  LED(arg, RIGHT_BLINKERS, 18, OFF, 0,                 RIGHT_BLINK_BIT,   0,               TURN_SIGNALS) \
+  LED(arg, STOP,           20, OFF, DAY_NIGHT_BIT,     0,                 BRAKE_LIGHT_BIT, TURN_SIGNALS) \
+  LED(arg, REVERSE,        21, OFF, REVERSE_LIGHT_BIT, 0,                 0,               TURN_SIGNALS) \
+  LED(arg, MARKERS,        22, OFF, DAY_NIGHT_BIT,     REVERSE_LIGHT_BIT, 0,               REVERSE_WARNING)
+
+/* Sequential turn signals on GPIO 10 to 12 and 13 to 15, and rear
+   strobes on GPIO 6 and 7 that alternate while the hazards are on,
+   wired as on the car. */
+#define PROFILE_SEQUENCER_GROUPS(GROUP, RULE) \
+  /*    name              base_pin pin_count rules */ \
+  GROUP(LEFT_SEQUENTIAL,  10,      3,        RULE(LEFT_BLINK_BIT, SEQUENTIAL)) \
+  GROUP(RIGHT_SEQUENTIAL, 13,      3,        RULE(RIGHT_BLINK_BIT, SEQUENTIAL)) \
+  GROUP(REAR_STROBES,      6,      2,        RULE(LEFT_BLINK_BIT | RIGHT_BLINK_BIT, STROBE))
+
+/* A strip across the back on GPIO 2. */
+#define PROFILE_WS2812_PIN 2
+#define PROFILE_PIXEL_COUNT 12
+
+#define PROFILE_PIXEL_RANGES(RANGE) \
+  RANGE(MARKERS,         0, 1, 0xff4000) \
+  RANGE(LEFT_BLINKERS,   1, 2, 0xff8000) \
+  RANGE(STOP,            3, 2, 0xff0000) \
+  RANGE(REVERSE,         5, 2, 0xffffff) \
+  RANGE(STOP,            7, 2, 0xff0000) \
+  RANGE(RIGHT_BLINKERS,  9, 2, 0xff8000) \
+  RANGE(MARKERS,        11, 1, 0xff4000)
+
+/* The channel rules of the towing car, so both follow the same
+   transmitter.  Channel numbers in the comments are one-based. */
+#define PROFILE_RC_CHANNEL_RULES(RULE) \
+  /*   bits                               channel min_us max_us */ \
+  RULE(BRAKE_LIGHT_BIT,                   1,      1300,  1460) /* channel 2, throttle: a little below neutral brakes */ \
+  RULE(REVERSE_LIGHT_BIT,                 1,       900,  1299) /* further below neutral reverses */ \
+  RULE(LEFT_BLINK_BIT,                    4,       900,  1250) /* channel 5, three position switch: left, off, right */ \
+  RULE(RIGHT_BLINK_BIT,                   4,      1750,  2100) \
+  RULE(LEFT_BLINK_BIT | RIGHT_BLINK_BIT,  6,      1500,  2100) /* channel 7, two position switch: hazards */ \
+  RULE(DAY_NIGHT_BIT,                     7,      1250,  2100) /* channel 8, three position switch: off, lights, hi beams */ \
+  RULE(HI_BEAMS_BIT,                      7,      1750,  2100)
+
+#define PROFILE_RC_SERVO_CHANNEL_RULES(RULE) \
+  /*   bits                               channel min_us max_us */ \
+  RULE(BRAKE_LIGHT_BIT,                   0,      1300,  1460) /* first pin, throttle: a little below neutral brakes */ \
+  RULE(REVERSE_LIGHT_BIT,                 0,       900,  1299) /* further below neutral reverses */ \
+  RULE(LEFT_BLINK_BIT,                    1,       900,  1250) /* second pin, three position switch: left, off, right */ \
+  RULE(RIGHT_BLINK_BIT,                   1,      1750,  2100) \
+  RULE(DAY_NIGHT_BIT,                     2,      1250,  2100) /* third pin, three position switch: off, lights, hi beams */ \
+  RULE(HI_BEAMS_BIT,                      2,      1750,  2100) \
+  RULE(LEFT_BLINK_BIT | RIGHT_BLINK_BIT,  3,      1500,  2100) /* fourth pin, two position switch: hazards */
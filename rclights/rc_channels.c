@@ -0,0 +1,36 @@
+// ********************************************************************************
+// Mapping of RC channels to master light states.
+// ********************************************************************************
+
+#include "rc_channels.h"
+#include "light_rules.h"
+#include "hot_path.h"
+
+/* The rules come from the vehicle profile, see vehicle_profile.h. */
+#define RC_CHANNEL_RULE_OF_PROFILE(bits_, channel_, min_us_, max_us_) \
+  { .bits = (bits_), .channel = (channel_), .min_us = (min_us_), .max_us = (max_us_) },
+
+const struct RcChannelRule RC_CHANNEL_RULES[] = {
+#if RC_SERVO_CHANNELS
+  PROFILE_RC_SERVO_CHANNEL_RULES(RC_CHANNEL_RULE_OF_PROFILE)
+#else
+  PROFILE_RC_CHANNEL_RULES(RC_CHANNEL_RULE_OF_PROFILE)
+#endif
+};
+
+const uint8_t RC_CHANNEL_RULE_COUNT = sizeof(RC_CHANNEL_RULES) / sizeof(RC_CHANNEL_RULES[0]);
+
+uint8_t RCLIGHTS_HOT_FUNC(rc_frame_to_master_lights_state)(const struct RcFrame* frame) {
+  uint8_t state = 0;
+
+  for (uint8_t i = 0; i < RC_CHANNEL_RULE_COUNT; i++) {
+    const struct RcChannelRule* rule = &RC_CHANNEL_RULES[i];
+
+    if (rule->channel < frame->channel_count
+        && frame->us[rule->channel] >= rule->min_us && frame->us[rule->channel] <= rule->max_us) {
+      state |= rule->bits;
+    }
+  }
+
+  return state;
+}
@@ -0,0 +1,52 @@
+// ********************************************************************************
+// Mapping of RC channels to master light states.
+//
+// A serial receiver or a PPM stream carries many channels, and the
+// PIO capture times several servo outputs, so instead of squeezing
+// every light function into the pulse width buckets of one channel,
+// each bit of the master lights state can follow its own channel
+// with a few wide ranges.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_RC_CHANNELS_H
+#define RCLIGHTS_RC_CHANNELS_H
+
+#include "rc_protocol.h"
+
+/* With RC_CHANNEL_MAP set to 0, only channel RC_MIX_CHANNEL is used
+   and it goes through the same filter and decoder as a servo pulse,
+   so a transmitter mix made for the PWM input keeps working. */
+#ifndef RC_CHANNEL_MAP
+#define RC_CHANNEL_MAP 1
+#endif
+
+/* Count of receiver servo outputs wired one per pin, as in the PIO
+   capture mode, or 0 when all channels of the receiver arrive, as
+   with a serial link or PPM.  Selects the rules and the mix channel
+   below. */
+#ifndef RC_SERVO_CHANNELS
+#define RC_SERVO_CHANNELS 0
+#endif
+
+#if RC_SERVO_CHANNELS
+#define RC_MIX_CHANNEL 0 // zero-based, the first pin
+#else
+#define RC_MIX_CHANNEL 5 // zero-based, channel 6 on most transmitters
+#endif
+
+struct RcChannelRule {
+  uint8_t bits;    // master lights state bits the rule sets
+  uint8_t channel; // zero-based
+  uint16_t min_us; // the bits are set while the channel is within min_us and max_us
+  uint16_t max_us;
+};
+
+extern const struct RcChannelRule RC_CHANNEL_RULES[];
+extern const uint8_t RC_CHANNEL_RULE_COUNT;
+
+/* Returns the master lights state the rules give for the channels of
+   frame.  Frames the receiver marks as failsafe never get here, see
+   input_channels.c. */
+uint8_t rc_frame_to_master_lights_state(const struct RcFrame* frame);
+
+#endif
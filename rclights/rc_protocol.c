@@ -0,0 +1,212 @@
+// ********************************************************************************
+// Serial RC receiver protocols.
+// ********************************************************************************
+
+#include <string.h>
+#include "rc_protocol.h"
+#include "hot_path.h"
+
+#define SBUS_FRAME_SIZE 25
+#define SBUS_HEADER 0x0f
+#define SBUS_FLAGS_FAILSAFE (1 << 3)
+
+#define IBUS_FRAME_SIZE 32
+#define IBUS_HEADER_0 0x20 // also the frame length
+#define IBUS_HEADER_1 0x40 // command: servo channels
+#define IBUS_CHANNEL_COUNT 14
+
+#define CRSF_ADDRESS_FLIGHT_CONTROLLER 0xc8
+#define CRSF_ADDRESS_TRANSMITTER 0xee // what some receivers send to the flight controller
+#define CRSF_MIN_LENGTH 2  // type and crc
+#define CRSF_MAX_LENGTH 62
+#define CRSF_TYPE_RC_CHANNELS 0x16
+#define CRSF_RC_CHANNELS_PAYLOAD_SIZE 22
+
+_Static_assert(CRSF_MAX_LENGTH + 2 <= RC_PARSER_BUFFER_SIZE, "RC_PARSER_BUFFER_SIZE must fit the longest CRSF frame");
+
+/* Each protocol tells whether the first count bytes of bytes can be
+   the start of a frame of its own, going by the header bytes among
+   them. */
+typedef bool (*RcStartsFrame)(const uint8_t* bytes, uint8_t count);
+
+/* Drops the first byte of the buffer and whatever follows up to the
+   next bytes that can start a frame, so that a frame starting inside
+   a bad one is not missed.  What is left always starts like a frame,
+   headers included, or is empty. */
+static void RCLIGHTS_HOT_FUNC(rc_parser_resync)(struct RcParser* parser, RcStartsFrame starts_frame) {
+  uint8_t skip = 1;
+
+  while (skip < parser->length && !starts_frame(parser->buffer + skip, parser->length - skip)) {
+    skip++;
+  }
+
+  parser->length -= skip;
+  memmove(parser->buffer, parser->buffer + skip, parser->length);
+}
+
+/* The following function adds a byte to the buffer and resyncs when
+   the buffer no longer starts like a frame.  Then the headers in the
+   buffer are always valid, so a frame is complete, and taken out of
+   the buffer, before the buffer fills up. */
+static void RCLIGHTS_HOT_FUNC(rc_parser_append)(struct RcParser* parser, uint8_t byte, RcStartsFrame starts_frame) {
+  parser->buffer[parser->length++] = byte;
+
+  if (!starts_frame(parser->buffer, parser->length)) {
+    rc_parser_resync(parser, starts_frame);
+  }
+}
+
+/* SBUS and CRSF pack 16 channels of 11 bits, least significant bit
+   first, with 992 at the centre.  Values run from 172 to 1811 for
+   transmitter outputs of -100% to +100%, which a servo would see as
+   988 to 2012 microseconds. */
+static void RCLIGHTS_HOT_FUNC(rc_unpack_11bit_channels)(const uint8_t* data, struct RcFrame* frame) {
+  uint32_t bits = 0;
+  uint8_t bit_count = 0;
+
+  for (int ch = 0; ch < RC_CHANNEL_COUNT; ch++) {
+    while (bit_count < 11) {
+      bits |= (uint32_t)*data++ << bit_count;
+      bit_count += 8;
+    }
+
+    frame->us[ch] = 1500 + (((int32_t)(bits & 0x7ff) - 992) * 5) / 8;
+    bits >>= 11;
+    bit_count -= 11;
+  }
+
+  frame->channel_count = RC_CHANNEL_COUNT;
+}
+
+// ********************************************************************************
+// SBUS
+//
+// Frames are a header byte, 22 bytes of channels, a flags byte and a
+// footer byte of 0x00, or of 0x?4 for SBUS2 telemetry slots.
+
+static bool RCLIGHTS_HOT_FUNC(sbus_starts_frame)(const uint8_t* bytes, uint8_t count) {
+  return bytes[0] == SBUS_HEADER;
+}
+
+bool RCLIGHTS_HOT_FUNC(sbus_parse_byte)(struct RcParser* parser, uint8_t byte, struct RcFrame* frame) {
+  rc_parser_append(parser, byte, sbus_starts_frame);
+
+  if (parser->length < SBUS_FRAME_SIZE) {
+    return false;
+  }
+
+  const uint8_t footer = parser->buffer[SBUS_FRAME_SIZE - 1];
+
+  if (footer != 0x00 && (footer & 0x0f) != 0x04) {
+    rc_parser_resync(parser, sbus_starts_frame);
+    return false;
+  }
+
+  rc_unpack_11bit_channels(&parser->buffer[1], frame);
+  frame->failsafe = parser->buffer[23] & SBUS_FLAGS_FAILSAFE;
+  parser->length = 0;
+
+  return true;
+}
+
+// ********************************************************************************
+// iBUS
+//
+// Frames are two header bytes, 14 channels in microseconds as little
+// endian 16 bit words, and a checksum word equal to 0xffff minus the
+// sum of the bytes before it.
+
+static bool RCLIGHTS_HOT_FUNC(ibus_starts_frame)(const uint8_t* bytes, uint8_t count) {
+  return bytes[0] == IBUS_HEADER_0 && (count < 2 || bytes[1] == IBUS_HEADER_1);
+}
+
+bool RCLIGHTS_HOT_FUNC(ibus_parse_byte)(struct RcParser* parser, uint8_t byte, struct RcFrame* frame) {
+  rc_parser_append(parser, byte, ibus_starts_frame);
+
+  if (parser->length < IBUS_FRAME_SIZE) {
+    return false;
+  }
+
+  uint16_t checksum = 0xffff;
+
+  for (int i = 0; i < IBUS_FRAME_SIZE - 2; i++) {
+    checksum -= parser->buffer[i];
+  }
+
+  if (checksum != (parser->buffer[30] | (parser->buffer[31] << 8))) {
+    rc_parser_resync(parser, ibus_starts_frame);
+    return false;
+  }
+
+  for (int ch = 0; ch < IBUS_CHANNEL_COUNT; ch++) {
+    frame->us[ch] = (parser->buffer[2 + 2 * ch] | (parser->buffer[3 + 2 * ch] << 8)) & 0x0fff;
+  }
+
+  for (int ch = IBUS_CHANNEL_COUNT; ch < RC_CHANNEL_COUNT; ch++) {
+    frame->us[ch] = 0;
+  }
+
+  frame->channel_count = IBUS_CHANNEL_COUNT;
+  frame->failsafe = false; // receivers signal failsafe by sending their failsafe values
+  parser->length = 0;
+
+  return true;
+}
+
+// ********************************************************************************
+// CRSF
+//
+// Frames are an address byte, a length byte counting the bytes that
+// follow it, a type byte, the payload and a CRC-8 with polynomial
+// 0xd5 over type and payload.  Only RC channels frames carry
+// channels, other types are skipped.  The receiver sends no frames at
+// all while it has no link.
+
+static bool RCLIGHTS_HOT_FUNC(crsf_starts_frame)(const uint8_t* bytes, uint8_t count) {
+  if (bytes[0] != CRSF_ADDRESS_FLIGHT_CONTROLLER && bytes[0] != CRSF_ADDRESS_TRANSMITTER) {
+    return false;
+  }
+
+  return count < 2 || (bytes[1] >= CRSF_MIN_LENGTH && bytes[1] <= CRSF_MAX_LENGTH);
+}
+
+static uint8_t RCLIGHTS_HOT_FUNC(crsf_crc8)(const uint8_t* data, uint8_t length) {
+  uint8_t crc = 0;
+
+  for (uint8_t i = 0; i < length; i++) {
+    crc ^= data[i];
+
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0xd5 : crc << 1;
+    }
+  }
+
+  return crc;
+}
+
+bool RCLIGHTS_HOT_FUNC(crsf_parse_byte)(struct RcParser* parser, uint8_t byte, struct RcFrame* frame) {
+  rc_parser_append(parser, byte, crsf_starts_frame);
+
+  if (parser->length < 2 || parser->length < parser->buffer[1] + 2) {
+    return false;
+  }
+
+  const uint8_t length = parser->buffer[1];
+  const uint8_t type = parser->buffer[2];
+
+  if (crsf_crc8(&parser->buffer[2], length - 1) != parser->buffer[length + 1]) {
+    rc_parser_resync(parser, crsf_starts_frame);
+    return false;
+  }
+
+  parser->length = 0;
+
+  if (type != CRSF_TYPE_RC_CHANNELS || length != CRSF_RC_CHANNELS_PAYLOAD_SIZE + 2) {
+    return false;
+  }
+
+  rc_unpack_11bit_channels(&parser->buffer[3], frame);
+  frame->failsafe = false;
+
+  return true;
+}
@@ -0,0 +1,48 @@
+// ********************************************************************************
+// Serial RC receiver protocols.
+//
+// Parsers for the frames that SBUS, iBUS and CRSF receivers send over
+// a UART.  They take one byte at a time, resynchronize on their own
+// after garbage or a lost byte and report the channels of every valid
+// frame in microseconds, like a servo pulse would.  Like the filters,
+// they do not depend on the Pico SDK.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_RC_PROTOCOL_H
+#define RCLIGHTS_RC_PROTOCOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RC_CHANNEL_COUNT 16 // channels this side keeps, iBUS sends 14 and the others 16
+
+#define RC_PARSER_BUFFER_SIZE 64 // fits the longest CRSF frame
+
+struct RcFrame {
+  uint16_t us[RC_CHANNEL_COUNT]; // width of each channel in microseconds
+  uint8_t channel_count;         // channels the protocol carries
+  bool failsafe;                 // the receiver lost the transmitter
+};
+
+struct RcParser {
+  uint8_t buffer[RC_PARSER_BUFFER_SIZE];
+  uint8_t length;
+};
+
+/* SBUS: 100000 baud, 8 data bits, even parity, 2 stop bits, inverted. */
+static const uint32_t SBUS_BAUD_RATE = 100000;
+
+/* iBUS: 115200 baud, 8N1. */
+static const uint32_t IBUS_BAUD_RATE = 115200;
+
+/* CRSF: 420000 baud, 8N1. */
+static const uint32_t CRSF_BAUD_RATE = 420000;
+
+/* Each of the following functions adds a byte to the parser and
+   returns true when the byte completed a valid frame, which is then
+   stored in frame.  The frame is left alone otherwise. */
+bool sbus_parse_byte(struct RcParser* parser, uint8_t byte, struct RcFrame* frame);
+bool ibus_parse_byte(struct RcParser* parser, uint8_t byte, struct RcFrame* frame);
+bool crsf_parse_byte(struct RcParser* parser, uint8_t byte, struct RcFrame* frame);
+
+#endif
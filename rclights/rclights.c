@@ -5,358 +5,279 @@
 
 #include <stdio.h>
 #include "pico/stdlib.h"
-#include "hardware/pwm.h"
-#include "hardware/clocks.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#include "input_capture.h"
+#include "input_channels.h"
+#include "input_filter.h"
+#include "master_state.h"
+#include "light_rules.h"
+#include "leds.h"
+#include "latency.h"
+#include "telemetry.h"
+#include "sys_clock.h"
+#include "sequencer.h"
+#include "ws2812.h"
+#include "failsafe.h"
+#include "calibration.h"
+#include "trace_record.h"
+#include "metrics.h"
+#include "hot_path.h"
 
 // ********************************************************************************
-// Measuring of input PWM
-
-const uint INPUT_PIN = 27;
-const uint INPUT_SLICE = 5;
-
-const float SYS_CLK_FREQ = 125000000; // 125 MHz
-const float INPUT_PWM_SYS_CLK_DIV = 125; // this value divides the system clock frequency to slow down the PWM measuring slice/component, a value of 125 slows down the PWM slice to 1 MHz or 1 PWM measure cycle per microsecond.
-
-const float INPUT_PWM_FREQ = 62; // for example, a value of 50 corresponds to 50 Hz or 1 period/frame every 20 miliseconds
-const float INPUT_PWM_PERIOD_MS = 1000 / INPUT_PWM_FREQ;
-const float INPUT_PWM_COUNTER_UNITS_PER_SEC = 1000000; // each counter unit corresponds to 1 microsecond
-const uint16_t INPUT_PWM_COUNTER_MAX = INPUT_PWM_COUNTER_UNITS_PER_SEC / INPUT_PWM_FREQ; // aka counter TOP or WRAP in Pico's docs, the amount of microseconds in one period/frame of the input signal
-
-#define INPUT_PWM_AVG_SAMPLES 5
-
-#define INPUT_PWM_SMOOTH_SAMPLES 4
-
-uint init_pwm_measuring() {
-  // Sanity checks
-  assert(clock_get_hz(clk_sys)            == SYS_CLK_FREQ);
-  assert(pwm_gpio_to_channel(INPUT_PIN)   == PWM_CHAN_B);
-  assert(pwm_gpio_to_slice_num(INPUT_PIN) == INPUT_SLICE);
+// Program entry point
+//
+// With RCLIGHTS_DUAL_CORE set to 1, core 1 measures, filters and
+// decodes the input while core 0 renders the lights, so blinking on
+// core 0 never waits for a measurement.  Otherwise core 0 does
+// everything in one loop.  With RCLIGHTS_SLEEP_WHEN_IDLE set to 1,
+// the loops sleep between input events instead of spinning, see
+// input_capture.h.
+
+#ifndef RCLIGHTS_DUAL_CORE
+#define RCLIGHTS_DUAL_CORE 0
+#endif
+
+/* Master lights state shown from power-on until the input first
+   decodes to a valid state. */
+#ifndef BOOT_MASTER_LIGHTS_STATE
+#define BOOT_MASTER_LIGHTS_STATE FAILSAFE_MASTER_LIGHTS_STATE
+#endif
+
+static uint32_t boot_lights_us = 0; // time_us_32() at which the boot state was rendered
+static bool boot_first_state_seen = false;
+
+/* The following function drives the boot state on every output right
+   after the clocks are up, before stdio and the capture start, so
+   the lights never show a state nobody asked for. */
+static void init_boot_lights() {
+  init_leds();
+  init_blink_groups();
+  init_sequencer();
+  init_ws2812();
+  render_master_lights_state(BOOT_MASTER_LIGHTS_STATE);
+  sequence_master_lights_state(BOOT_MASTER_LIGHTS_STATE);
 
-  gpio_set_function(INPUT_PIN, GPIO_FUNC_PWM);
-  pwm_set_clkdiv_mode(INPUT_SLICE, PWM_DIV_B_HIGH);
-  pwm_set_clkdiv(INPUT_SLICE, INPUT_PWM_SYS_CLK_DIV);
-  pwm_set_wrap(INPUT_SLICE, INPUT_PWM_COUNTER_MAX); 
+  boot_lights_us = time_us_32();
 }
 
-float measure_input_pwm_hi_us() {
-  pwm_set_counter(INPUT_SLICE, 0);
-  pwm_set_enabled(INPUT_SLICE, true);
-  sleep_ms(INPUT_PWM_PERIOD_MS);
-  pwm_set_enabled(INPUT_SLICE, false);
+/* The following function holds the boot state until a decode is
+   valid, then reports how long after power-on the boot lights and
+   the first valid state came. */
+static uint8_t RCLIGHTS_HOT_FUNC(boot_master_lights_state)(uint8_t state, bool valid) {
+  if (!boot_first_state_seen) {
+    if (!valid) {
+      return BOOT_MASTER_LIGHTS_STATE;
+    }
 
-  float hi_us = pwm_get_counter(INPUT_SLICE);
+    const uint32_t first_state_us = time_us_32();
 
-  /* printf("hi_us = %f\n", hi_us); */
+    boot_first_state_seen = true;
+    latency_note_boot(boot_lights_us, first_state_us);
+    telemetry_note_boot(boot_lights_us, first_state_us);
+  }
 
-  return hi_us;
+  return state;
 }
 
-/* The following function returns the average of the last
-   INPUT_PWM_AVG_SAMPLES input values.  This is one way to workaround
-   noise in the input signal.  It trades off read cycles for a
-   sequence of values that is less bumpy but might be away from most
-   of the input values if peaks are too big. */
-float average_input_pwm_hi_us() {
-  static uint8_t curr_sample = 0;
-  static float samples[INPUT_PWM_AVG_SAMPLES + 1];
-  static float avg_hi_us = 0;
+/* The following function reads the input and returns the master
+   lights state it asks for. */
+static uint8_t RCLIGHTS_HOT_FUNC(next_master_lights_state)() {
+#if INPUT_CAPTURE_CHANNELS && RC_CHANNEL_MAP
+  metrics_stage(METRICS_DECODE);
 
-  uint8_t oldest_sample = (curr_sample + 1) % (INPUT_PWM_AVG_SAMPLES + 1);
+  uint8_t master_lights_state = input_channels_master_lights_state();
 
-  samples[curr_sample] = measure_input_pwm_hi_us() / INPUT_PWM_AVG_SAMPLES;
-  avg_hi_us += samples[curr_sample] - samples[oldest_sample];
-  curr_sample = oldest_sample;
+  master_lights_state = failsafe_master_lights_state(boot_master_lights_state(master_lights_state, input_frame_count > 0));
 
-  return avg_hi_us;
-}
-
-/* The following function returns the last smooth value until enough
-   input PWM values are the same.  INPUT_PWM_SMOOT_SAMPLES defines
-   many is enough.  This is one way to workaround noise in the input
-   signal.  It trades off read cycles for a squence of values that
-   ignores peaks but might not follow the average of the input signal
-   if there is too much noise.  */
-float smooth_input_pwm_hi_us() {
-  static float smooth_hi_us = 0;
-  static uint8_t curr_sample = 0;
-  static float samples[INPUT_PWM_SMOOTH_SAMPLES];
-
-  /* You might want to experiment reading values directly or reading
-     an averaged value on the next line. */
-  float avg_hi_us = measure_input_pwm_hi_us(); // average_input_pwm_hi_us();
-  samples[curr_sample] = avg_hi_us;
-
-  /* printf("avg_hi_us = %f\n", avg_hi_us); */
-
-  if (avg_hi_us != smooth_hi_us) {
-    bool all_equal = true;
-
-    for (int i = 0; i < INPUT_PWM_SMOOTH_SAMPLES; i++) {
-      all_equal = all_equal && samples[i] == avg_hi_us;
-    }
+  telemetry_note_frame(input_frame_hi_us, master_lights_state);
+  trace_record_note_frame(master_lights_state);
+#else
+  metrics_stage(METRICS_FILTER);
 
-    if (all_equal) {
-      smooth_hi_us = avg_hi_us;
-    }
-  }
+  hi_us_t input_pwm_hi_us = filter_input_pwm_hi_us();
 
-  curr_sample = (curr_sample + 1) % INPUT_PWM_SMOOTH_SAMPLES;
+  /* printf("input_pwm_hi_us = %f\n", input_pwm_hi_us); */
 
-  return smooth_hi_us;
-}  
+  metrics_stage(METRICS_DECODE);
 
+  uint8_t master_lights_state = input_pwm_hi_us_to_master_lights_state(input_pwm_hi_us);
 
-// ********************************************************************************
-// Data structure Led and corresponding operations that control leds
-// connected to GPIO pins.
-
-const uint16_t OUTPUT_PWM_MAX_LEVEL = 100;
-const uint16_t OUTPUT_PWM_ON_LEVEL = 20;
-const uint16_t OUTPUT_PWM_OFF_LEVEL = 0;
-const uint16_t OUTPUT_PWM_HI_LEVEL = 100;
-
-const uint32_t BLINK_INTERVAL_US = 400000;
-
-enum LedState {
-  OFF,
-  ON,
-  HI,
-};
-
-struct Led {
-  const uint id;
-  uint pwm_slice;
-  enum LedState state;
-};
-
-struct Led FRONT_WHITE = {
-  .id = 17,
-  .pwm_slice = -1,
-  .state = OFF,
-};
-struct Led FRONT_BLUE = {
-  .id = 18,
-  .pwm_slice = -1,
-  .state = OFF,
-};
-struct Led LEFT_BLINKERS = {
-  .id = 20,
-  .pwm_slice = -1,
-  .state = OFF,
-};
-struct Led RIGHT_BLINKERS = {
-  .id = 21,
-  .pwm_slice = -1,
-  .state = OFF,
-};
-struct Led STOP = {
-  .id = 22,
-  .pwm_slice = -1,
-  .state = OFF,
-};
-struct Led REVERSE = {
-  .id = 28,
-  .pwm_slice = -1,
-  .state = OFF,
-};
-
-void init_led(struct Led* led) {
-  led->pwm_slice = pwm_gpio_to_slice_num(led->id);
-
-  gpio_set_function(led->id, GPIO_FUNC_PWM);
-  pwm_set_wrap(led->pwm_slice, OUTPUT_PWM_MAX_LEVEL);
-  pwm_set_enabled(led->pwm_slice, true);
-}
+  master_lights_state = failsafe_master_lights_state(boot_master_lights_state(master_lights_state,
+                                                                              input_pwm_hi_us_in_range(input_pwm_hi_us)));
 
-void init_leds() {
-  init_led(&FRONT_WHITE);
-  init_led(&FRONT_BLUE);
-  init_led(&LEFT_BLINKERS);
-  init_led(&RIGHT_BLINKERS);
-  init_led(&STOP);
-  init_led(&REVERSE);
-}
+  /* printf("master_lights_state = %b\n", master_lights_state); */
 
-void turn_led_off(struct Led* led) {
-  if (led->state == OFF) {
-    return;
-  }
+  telemetry_note_frame(input_pwm_hi_us, master_lights_state);
+  trace_record_note_frame(master_lights_state);
+#endif
 
-  pwm_set_gpio_level(led->id, OUTPUT_PWM_OFF_LEVEL);
-  led->state = OFF;
+  return master_lights_state;
 }
 
-void turn_led_on(struct Led* led) {
-  if (led->state == ON) {
-    return;
+/* The following function sleeps until new input is ready or an
+   interrupt needs the loop, such as a USB request or a blink timer.
+   Interrupts stay masked from the check to __wfi(), so one that
+   arrives in between does not go unnoticed: a pending interrupt ends
+   __wfi() even while masked and is taken as soon as they are
+   restored. */
+static void RCLIGHTS_HOT_FUNC(wait_for_input)() {
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+  uint32_t interrupts = save_and_disable_interrupts();
+
+  if (!input_pwm_hi_us_ready()) {
+    __wfi();
   }
 
-  pwm_set_gpio_level(led->id, OUTPUT_PWM_ON_LEVEL);
-  led->state = ON;
+  restore_interrupts(interrupts);
+#endif
 }
 
-void turn_led_hi(struct Led* led) {
-  if (led->state == HI) {
-    return;
-  }
+/* The following function reads a command character from stdio, if
+   one arrived, without waiting: 'l' prints the latency report, 't'
+   dumps the trace and 'w' saves it to flash. */
+static void poll_stdio_commands() {
+#if RCLIGHTS_LATENCY_STATS || RCLIGHTS_TRACE_RECORD
+  const int command = getchar_timeout_us(0);
+
+  if (command != PICO_ERROR_TIMEOUT) {
+#if RCLIGHTS_TRACE_RECORD
+    /* Saving the trace stops the decoding for about a second, during
+       which the outputs hold what they show.  Make that the failsafe
+       state; the next pass of the loop renders the decoded state
+       again, since it differs from the rendered one. */
+    if (command == TRACE_RECORD_SAVE_COMMAND) {
+      render_master_lights_state(FAILSAFE_MASTER_LIGHTS_STATE);
+      sequence_master_lights_state(FAILSAFE_MASTER_LIGHTS_STATE);
+    }
+#endif
 
-  pwm_set_gpio_level(led->id, OUTPUT_PWM_HI_LEVEL);
-  led->state = HI;
+    latency_handle_command(command);
+    trace_record_handle_command(command);
+  }
+#endif
 }
 
-void blink_led(struct Led* led) {
-  static uint32_t next_us = 0;
-  static bool blink_on = false;
+#if RCLIGHTS_DUAL_CORE
 
-  const uint32_t curr_us = time_us_32();
+/* Single slot mailbox from core 1 to core 0.  Only core 1 writes it
+   and a byte store is atomic, so core 0 always reads a whole state,
+   the newest one, without locking. */
+static volatile uint8_t master_lights_mailbox = BOOT_MASTER_LIGHTS_STATE;
 
-  if (next_us < curr_us) {
-    next_us = curr_us + BLINK_INTERVAL_US;
-    blink_on = !blink_on;
-  }
+void RCLIGHTS_HOT_FUNC(core1_main)() {
+#if RCLIGHTS_TRACE_RECORD
+  multicore_lockout_victim_init(); // lets core 0 save the trace to flash
+#endif
 
-  if (blink_on) {
-    turn_led_on(led);
-  } else if (led->state == ON && !blink_on) {
-    turn_led_off(led);
-  }
-}
+  /* The capture IRQs are enabled here so that they run on core 1. */
+  init_pwm_measuring();
+  init_failsafe();
 
-// ********************************************************************************
-// Conversion of input PWM to master light states
+  uint8_t master_lights_state = BOOT_MASTER_LIGHTS_STATE;
 
-const float INPUT_PWM_US_RANGE_MIN = 1019; // You might need to adjust these to match the MIN microseconds duty cycle for your transmitter/receiver combination
-const float INPUT_PWM_US_RANGE_MAX = 1981; // Similar warning as that of INPUT_PWM_US_RANGE_MIN
-const float INPUT_PWM_US_RANGE_SIZE = INPUT_PWM_US_RANGE_MAX - INPUT_PWM_US_RANGE_MIN + 1;
-const float MASTER_LIGHT_STATE_COUNT = 48;
-const float INPUT_PWM_US_BUCKET_SIZE = INPUT_PWM_US_RANGE_SIZE / (MASTER_LIGHT_STATE_COUNT - 1);
+  init_metrics();
 
-uint8_t input_pwm_hi_us_to_master_state_id(float hi_us) {
-  /* ******************************************************************************** */
-  /* Iterative way for debugging purposes.*/
-  /* uint8_t state_id = 0; */
-  /* float current_threshold = INPUT_PWM_US_RANGE_MIN + INPUT_PWM_US_BUCKET_SIZE / 2; */
+  while(true) {
+    metrics_stage(METRICS_CAPTURE_WAIT);
+    wait_for_input();
 
-  /* while(current_threshold < hi_us) { */
-  /*   state_id++; */
-  /*   current_threshold += INPUT_PWM_US_BUCKET_SIZE; */
-  /* } */
+    uint8_t state = next_master_lights_state();
 
-  /* printf("current_threshold = %f\n", current_threshold); */
+    if (state != master_lights_state) {
+      master_lights_state = state;
+      latency_note_state(state);
+      master_lights_mailbox = state;
+    }
 
-  /* return state_id; */
-  /* ******************************************************************************** */
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+    __sev(); // wakes core 0 for the new state or telemetry
+#endif
 
-  return (hi_us - INPUT_PWM_US_RANGE_MIN + INPUT_PWM_US_BUCKET_SIZE / 2) / INPUT_PWM_US_BUCKET_SIZE;
+    metrics_loop();
+  }
 }
 
-uint8_t input_pwm_hi_us_to_master_lights_state(float hi_us) {
-  uint8_t state_id = input_pwm_hi_us_to_master_state_id(hi_us);
-
-  /* printf("state_id = %d\n", state_id); */
+int main() {
+  init_sys_clock();
+  init_input_pwm_calibration();
+  init_boot_lights();
 
-  uint8_t state = (state_id % 3) + ((state_id / 3) << 2);
+#if RCLIGHTS_LATENCY_STATS || RCLIGHTS_TELEMETRY || RCLIGHTS_TRACE_RECORD
+  stdio_init_all();
+#else
+  /* stdio_init_all(); */
+#endif
 
-  return state;
-}
+  multicore_launch_core1(core1_main);
+  init_failsafe_watchdog();
+  init_metrics();
 
-// ********************************************************************************
-// Application of master light states to light sets.
-//
-// Light sets introduced in the blog post do not correspond to a
-// concrete data structure, rather they are modelled by the
-// application of their corresponding rules in this section.
-
-void apply_front_white_light_rules(uint8_t day_night_state, uint8_t hi_beams_state) {
-  if (hi_beams_state) {
-    turn_led_hi(&FRONT_WHITE);
-    return;
-  }
+  while(true) {
+    metrics_stage(METRICS_CAPTURE_WAIT);
 
-  if (day_night_state) {
-    turn_led_on(&FRONT_WHITE);
-  } else {
-    turn_led_off(&FRONT_WHITE);
-  }
-}
+#if RCLIGHTS_SLEEP_WHEN_IDLE
+    /* An event from core 1 since the last pass ends __wfe() right
+       away, so none is missed between the render and here. */
+    __wfe();
+#endif
 
-void apply_blink_light_state(uint8_t state) {
-  switch(state) {
-  case 0: // off
-    turn_led_off(&LEFT_BLINKERS);
-    turn_led_off(&RIGHT_BLINKERS);
-    break;
-  case 1: // left
-    blink_led(&LEFT_BLINKERS);
-    turn_led_off(&RIGHT_BLINKERS);
-    break;
-  case 2: // right
-    turn_led_off(&LEFT_BLINKERS);
-    blink_led(&RIGHT_BLINKERS);
-    break;
-  default: // hazard
-    blink_led(&LEFT_BLINKERS);
-    blink_led(&RIGHT_BLINKERS);
-  }
-}
+    uint8_t master_lights_state = master_lights_mailbox;
 
-void apply_reverse_light_state(uint8_t state) {
-  if (state) {
-    turn_led_on(&REVERSE);
-  } else {
-    turn_led_off(&REVERSE);
-  }
-}
-
-void apply_stop_light_rules(uint8_t day_night_state, uint8_t brake_light_state) {
-  if (brake_light_state) {
-    turn_led_hi(&STOP);
-    return;
-  }
+    if (master_lights_state != rendered_master_lights_state) {
+      render_master_lights_state(master_lights_state);
+      sequence_master_lights_state(master_lights_state);
+    }
 
-  if (day_night_state) {
-    turn_led_on(&STOP);
-  } else {
-    turn_led_off(&STOP);
+    metrics_stage(METRICS_OTHER);
+    poll_stdio_commands();
+    telemetry_drain();
+    trace_record_drain();
+    failsafe_feed_watchdog();
+    metrics_loop();
   }
 }
 
-void apply_master_lights_state(uint8_t state) {
-  uint8_t brake_light_state = state & 1;
-  uint8_t reverse_light_state = (state >> 1) & 1;
-  uint8_t blink_light_state = (state >> 2) & 3;
-  uint8_t hi_beams_state = (state >> 4) & 1;
-  uint8_t day_night_state = (state >> 5) & 1;
-
-  apply_stop_light_rules(day_night_state, brake_light_state);
-  apply_reverse_light_state(reverse_light_state);
-  apply_blink_light_state(blink_light_state);
-  apply_front_white_light_rules(day_night_state, hi_beams_state);
-}
-
-// ********************************************************************************
-// Program entry point
+#else
 
 int main() {
+  init_sys_clock();
+  init_input_pwm_calibration();
+  init_boot_lights();
+
+#if RCLIGHTS_LATENCY_STATS || RCLIGHTS_TELEMETRY || RCLIGHTS_TRACE_RECORD
+  stdio_init_all();
+#else
   /* stdio_init_all(); */
+#endif
 
   init_pwm_measuring();
-  init_leds();
+  init_failsafe();
+  init_failsafe_watchdog();
 
-  turn_led_on(&FRONT_BLUE);
+  uint8_t master_lights_state = BOOT_MASTER_LIGHTS_STATE;
 
-  float input_pwm_hi_us = 0;
-  uint8_t master_lights_state = 0;
+  init_metrics();
 
   while(true) {
-    input_pwm_hi_us = smooth_input_pwm_hi_us();
+    metrics_stage(METRICS_CAPTURE_WAIT);
+    wait_for_input();
 
-    /* printf("input_pwm_hi_us = %f\n", input_pwm_hi_us); */
+    master_lights_state = next_master_lights_state();
 
-    master_lights_state = input_pwm_hi_us_to_master_lights_state(input_pwm_hi_us);
-
-    /* printf("master_lights_state = %b\n", master_lights_state); */
+    if (master_lights_state != rendered_master_lights_state) {
+      latency_note_state(master_lights_state);
+      render_master_lights_state(master_lights_state);
+      sequence_master_lights_state(master_lights_state);
+    }
 
-    apply_master_lights_state(master_lights_state);
+    metrics_stage(METRICS_OTHER);
+    poll_stdio_commands();
+    telemetry_drain();
+    trace_record_drain();
+    failsafe_feed_watchdog();
+    metrics_loop();
   }
 }
+
+#endif
@@ -0,0 +1,281 @@
+// ********************************************************************************
+// Loopback self-test of the capture, filtering and decoding of input PWM
+//
+// Wire SELFTEST_PIN to INPUT_PIN.  Core 1 generates servo pulses on
+// SELFTEST_PIN from the spare PWM slice SELFTEST_SLICE, one per input
+// period, while core 0 runs them through the same capture, filter
+// and decoder as rclights.  For every state id the sweep steps, from
+// the centre of a far away id, to the centre of the id, to either edge
+// of its bucket and to its centre with injected jitter, and counts
+// how many frames it takes until the decoded master lights state is
+// correct and whether it stays correct afterwards.  The results are
+// printed over USB serial after every sweep.
+// ********************************************************************************
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pwm.h"
+#include "input_capture.h"
+#include "input_filter.h"
+#include "master_state.h"
+#include "sys_clock.h"
+
+const uint SELFTEST_PIN = 8;
+const uint SELFTEST_SLICE = 4;
+
+const float SELFTEST_PWM_SYS_CLK_DIV = SYS_CLK_DIV_TO_1MHZ; // 1 MHz, one PWM cycle per microsecond as for measuring
+
+#define SELFTEST_EDGE_US ((2 * INPUT_PWM_US_RANGE_SIZE) / (5 * (MASTER_LIGHT_STATE_COUNT - 1))) // 0.4 bucket off the centre
+#define SELFTEST_JITTER_US 2 // uniform, in both directions
+#define SELFTEST_TIMEOUT_FRAMES 62 // about a second
+#define SELFTEST_HOLD_FRAMES 31 // frames the decoded state must stay correct once reached
+
+// ********************************************************************************
+// Pulse generator on core 1
+//
+// Core 0 requests a step as one word holding a sequence number, the
+// jitter and the width, so core 1 never sees half of a request.  On
+// every wrap of the generator slice, core 1 picks up the latest
+// request and loads the width of the next pulse.  Compare registers
+// latch on wrap, so a step picked up at frame n shows from frame n + 1
+// on.
+
+#define SELFTEST_STEP(seq, jitter_us, width_us) (((uint32_t)(seq) << 24) | ((uint32_t)(jitter_us) << 16) | (width_us))
+#define SELFTEST_STEP_SEQ(step) ((step) >> 24)
+#define SELFTEST_STEP_JITTER_US(step) (((step) >> 16) & 0xff)
+#define SELFTEST_STEP_WIDTH_US(step) ((step) & 0xffff)
+
+static volatile uint32_t selftest_requested_step = 0;
+static volatile uint32_t selftest_applied_seq = 0;
+static volatile uint32_t selftest_step_frame = 0; // frame of the first pulse of the applied step
+static volatile uint32_t selftest_frame = 0; // count of generated periods
+
+static uint32_t selftest_random_state = 1;
+
+static int selftest_jitter(uint8_t jitter_us) {
+  selftest_random_state = selftest_random_state * 1664525 + 1013904223;
+
+  return jitter_us ? (int)((selftest_random_state >> 16) % (2 * jitter_us + 1)) - jitter_us : 0;
+}
+
+void selftest_generator_main() {
+  gpio_set_function(SELFTEST_PIN, GPIO_FUNC_PWM);
+  pwm_set_clkdiv(SELFTEST_SLICE, SELFTEST_PWM_SYS_CLK_DIV);
+  pwm_set_wrap(SELFTEST_SLICE, INPUT_PWM_COUNTER_MAX - 1); // one period per input period
+  pwm_set_chan_level(SELFTEST_SLICE, pwm_gpio_to_channel(SELFTEST_PIN), 0);
+  pwm_clear_irq(SELFTEST_SLICE);
+  pwm_set_enabled(SELFTEST_SLICE, true);
+
+  /* The wrap flag is polled rather than handled, so the generator
+     does not compete for PWM_IRQ_WRAP with the wrap capture mode. */
+  while(true) {
+    while (!(pwm_hw->intr & (1u << SELFTEST_SLICE))) {
+      tight_loop_contents();
+    }
+
+    pwm_clear_irq(SELFTEST_SLICE);
+
+    const uint32_t frame = selftest_frame + 1;
+    const uint32_t step = selftest_requested_step;
+
+    if (SELFTEST_STEP_SEQ(step) != selftest_applied_seq) {
+      selftest_step_frame = frame + 1;
+      selftest_applied_seq = SELFTEST_STEP_SEQ(step);
+    }
+
+    int width_us = SELFTEST_STEP_WIDTH_US(step) + selftest_jitter(SELFTEST_STEP_JITTER_US(step));
+    pwm_set_chan_level(SELFTEST_SLICE, pwm_gpio_to_channel(SELFTEST_PIN), width_us);
+
+    selftest_frame = frame;
+  }
+}
+
+// ********************************************************************************
+// Sweep on core 0
+
+enum SelftestCaseIndex {
+  CENTRE,
+  LOW_EDGE,
+  HIGH_EDGE,
+  JITTER,
+  SELFTEST_CASE_COUNT
+};
+
+struct SelftestCase {
+  const char* name;
+  int offset_us;
+  uint8_t jitter_us;
+};
+
+static const struct SelftestCase SELFTEST_CASES[SELFTEST_CASE_COUNT] = {
+  [CENTRE]    = { .name = "centre",    .offset_us = 0,                 .jitter_us = 0 },
+  [LOW_EDGE]  = { .name = "low edge",  .offset_us = -SELFTEST_EDGE_US, .jitter_us = 0 },
+  [HIGH_EDGE] = { .name = "high edge", .offset_us = SELFTEST_EDGE_US,  .jitter_us = 0 },
+  [JITTER]    = { .name = "jitter",    .offset_us = 0,                 .jitter_us = SELFTEST_JITTER_US },
+};
+
+struct SelftestResult {
+  uint32_t steps;
+  uint32_t frames_sum; // of the steps that reached the correct state
+  uint32_t frames_max;
+  uint32_t timeouts;
+  uint32_t glitches; // frames decoded wrong after the correct state was reached
+};
+
+static struct SelftestResult selftest_results[SELFTEST_CASE_COUNT];
+static uint8_t selftest_seq = 0;
+
+/* Centre of the bucket of state_id as the decoder sees it, held
+   within the input range. */
+static int selftest_centre_us(int state_id) {
+  int centre_us = INPUT_PWM_US_RANGE_MIN
+    + (state_id * INPUT_PWM_US_RANGE_SIZE + (MASTER_LIGHT_STATE_COUNT - 1) / 2) / (MASTER_LIGHT_STATE_COUNT - 1);
+
+  return centre_us < INPUT_PWM_US_RANGE_MAX ? centre_us : INPUT_PWM_US_RANGE_MAX;
+}
+
+static uint8_t selftest_decode() {
+  return input_pwm_hi_us_to_master_lights_state(filter_input_pwm_hi_us());
+}
+
+/* Requests a step and returns, once it shows, the frame of its first
+   pulse. */
+static uint32_t selftest_request(int width_us, uint8_t jitter_us) {
+  if (width_us < INPUT_PWM_US_RANGE_MIN) {
+    width_us = INPUT_PWM_US_RANGE_MIN;
+  } else if (width_us > INPUT_PWM_US_RANGE_MAX) {
+    width_us = INPUT_PWM_US_RANGE_MAX;
+  }
+
+  selftest_seq = (selftest_seq + 1) & 0xff;
+  selftest_requested_step = SELFTEST_STEP(selftest_seq, jitter_us, width_us);
+
+  while (selftest_applied_seq != selftest_seq) {
+    selftest_decode();
+  }
+
+  const uint32_t step_frame = selftest_step_frame;
+
+  while ((int32_t)(selftest_frame - step_frame) < 0) {
+    selftest_decode();
+  }
+
+  return step_frame;
+}
+
+/* The following function steps to width_us and returns how many
+   frames, counting from the first pulse of the step, it took until
+   the decoded state was expected, or 0 on timeout.  It then holds the
+   width for SELFTEST_HOLD_FRAMES and adds the frames that decoded to
+   anything else to glitches. */
+static uint32_t selftest_step(int width_us, uint8_t jitter_us, uint8_t expected, uint32_t* glitches) {
+  const uint32_t start_frame = selftest_request(width_us, jitter_us);
+  uint32_t frames = 0;
+
+  while (selftest_frame - start_frame < SELFTEST_TIMEOUT_FRAMES) {
+    uint8_t state = selftest_decode();
+
+    if (state == expected) {
+      frames = selftest_frame - start_frame + 1;
+      break;
+    }
+  }
+
+  if (frames == 0) {
+    return 0;
+  }
+
+  const uint32_t hold_frame = selftest_frame;
+  uint32_t checked_frame = hold_frame;
+
+  while (selftest_frame - hold_frame < SELFTEST_HOLD_FRAMES) {
+    const uint32_t frame = selftest_frame;
+    uint8_t state = selftest_decode();
+
+    if (frame != checked_frame) { // check once per frame
+      checked_frame = frame;
+      *glitches += state != expected;
+    }
+  }
+
+  return frames;
+}
+
+/* Parks the input at a far away id and waits until it decodes, so
+   every measured step is a real change of state. */
+static void selftest_park(int state_id) {
+  uint32_t glitches = 0;
+  const int far_id = (state_id + MASTER_LIGHT_STATE_COUNT / 2) % MASTER_LIGHT_STATE_COUNT;
+
+  selftest_step(selftest_centre_us(far_id), 0, MASTER_LIGHTS_STATE_OF_ID(far_id), &glitches);
+}
+
+static void selftest_sweep() {
+  for (int c = 0; c < SELFTEST_CASE_COUNT; c++) {
+    selftest_results[c] = (struct SelftestResult){ 0 };
+  }
+
+  for (int state_id = 0; state_id < MASTER_LIGHT_STATE_COUNT; state_id++) {
+    const uint8_t expected = MASTER_LIGHTS_STATE_OF_ID(state_id);
+
+    for (int c = 0; c < SELFTEST_CASE_COUNT; c++) {
+      const struct SelftestCase* test = &SELFTEST_CASES[c];
+      struct SelftestResult* result = &selftest_results[c];
+      const int width_us = selftest_centre_us(state_id) + test->offset_us;
+
+      selftest_park(state_id);
+
+      uint32_t glitches = 0;
+      uint32_t frames = selftest_step(width_us, test->jitter_us, expected, &glitches);
+
+      result->steps++;
+      result->glitches += glitches;
+
+      if (frames == 0) {
+        result->timeouts++;
+        printf("id %2d %-9s %4d us: timeout\n", state_id, test->name, width_us);
+        continue;
+      }
+
+      result->frames_sum += frames;
+      result->frames_max = frames > result->frames_max ? frames : result->frames_max;
+
+      if (glitches) {
+        printf("id %2d %-9s %4d us: %u glitches\n", state_id, test->name, width_us, glitches);
+      }
+    }
+  }
+}
+
+static void selftest_report() {
+  printf("case       steps  frames mean  max  timeouts  glitches\n");
+
+  for (int c = 0; c < SELFTEST_CASE_COUNT; c++) {
+    const struct SelftestResult* result = &selftest_results[c];
+    const uint32_t reached = result->steps - result->timeouts;
+
+    printf("%-9s  %5u  %11.2f  %3u  %8u  %8u\n",
+           SELFTEST_CASES[c].name, result->steps,
+           reached ? (float)result->frames_sum / reached : 0.0f,
+           result->frames_max, result->timeouts, result->glitches);
+  }
+}
+
+// ********************************************************************************
+// Program entry point
+
+int main() {
+  init_sys_clock();
+  stdio_init_all();
+
+  init_pwm_measuring();
+
+  multicore_launch_core1(selftest_generator_main);
+
+  for (uint32_t sweep = 1; true; sweep++) {
+    printf("rclights self-test, sweep %u, wire GPIO %u to the input pin\n", sweep, SELFTEST_PIN);
+    selftest_sweep();
+    selftest_report();
+  }
+}
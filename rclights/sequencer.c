@@ -0,0 +1,202 @@
+// ********************************************************************************
+// Pattern sequencer
+// ********************************************************************************
+
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "sequencer.h"
+#include "light_rules.h"
+#include "sys_clock.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_SEQUENCER
+
+#include "sequencer.pio.h"
+
+#ifndef PROFILE_SEQUENCER_GROUPS
+#error "RCLIGHTS_SEQUENCER needs a vehicle profile with sequencer groups"
+#endif
+
+#define SEQUENCER_PIO pio1 // pio0 may be taken by the PIO capture modes
+
+#define SEQUENCER_MAX_KEYFRAMES 16 // a power of two
+#define SEQUENCER_GROUP_RULES 2
+
+/* A keyframe sets the pins of a group, bit 0 for the first pin, and
+   holds them for a duration in milliseconds, see sequencer.pio. */
+#define SEQUENCER_KEYFRAME(pins, ms) ((((uint32_t)(ms) * 1000 - 3) << 8) | (pins))
+#define SEQUENCER_KEYFRAME_PINS(keyframe) ((keyframe) & 0xff)
+
+/* The DMA channels are started with the largest transfer count, good
+   for years of keyframes. */
+static const uint32_t SEQUENCER_DMA_TRANSFERS = 0xffffffff;
+
+// ********************************************************************************
+// Patterns
+
+enum SequencerPatternIndex {
+  SEQUENCER_OFF,
+  SEQUENCER_SEQUENTIAL, // lights the pins one after the other, then all go dark
+  SEQUENCER_STROBE,     // double flashes, alternating between the first and the second pin
+  SEQUENCER_PATTERN_COUNT,
+};
+
+struct SequencerPattern {
+  const uint32_t* keyframes;
+  uint8_t count;
+};
+
+static const uint32_t SEQUENCER_OFF_KEYFRAMES[] = {
+  SEQUENCER_KEYFRAME(0, 1000),
+};
+
+/* Same period as the blinkers. */
+static const uint32_t SEQUENCER_SEQUENTIAL_KEYFRAMES[] = {
+  SEQUENCER_KEYFRAME(0b001, 120),
+  SEQUENCER_KEYFRAME(0b011, 120),
+  SEQUENCER_KEYFRAME(0b111, 160),
+  SEQUENCER_KEYFRAME(0b000, 400),
+};
+
+static const uint32_t SEQUENCER_STROBE_KEYFRAMES[] = {
+  SEQUENCER_KEYFRAME(0b01, 50),
+  SEQUENCER_KEYFRAME(0b00, 50),
+  SEQUENCER_KEYFRAME(0b01, 50),
+  SEQUENCER_KEYFRAME(0b00, 150),
+  SEQUENCER_KEYFRAME(0b10, 50),
+  SEQUENCER_KEYFRAME(0b00, 50),
+  SEQUENCER_KEYFRAME(0b10, 50),
+  SEQUENCER_KEYFRAME(0b00, 150),
+};
+
+#define SEQUENCER_PATTERN(keyframes) { keyframes, sizeof(keyframes) / sizeof(keyframes[0]) }
+
+static const struct SequencerPattern SEQUENCER_PATTERNS[SEQUENCER_PATTERN_COUNT] = {
+  [SEQUENCER_OFF] = SEQUENCER_PATTERN(SEQUENCER_OFF_KEYFRAMES),
+  [SEQUENCER_SEQUENTIAL] = SEQUENCER_PATTERN(SEQUENCER_SEQUENTIAL_KEYFRAMES),
+  [SEQUENCER_STROBE] = SEQUENCER_PATTERN(SEQUENCER_STROBE_KEYFRAMES),
+};
+
+// ********************************************************************************
+// Groups
+//
+// A group is a run of consecutive pins of the vehicle profile.  The
+// first of its rules whose bits are all set in the master lights
+// state selects the pattern it plays; a group with no matching rule
+// is off.
+
+struct SequencerRule {
+  uint8_t bits;
+  enum SequencerPatternIndex pattern;
+};
+
+struct SequencerGroup {
+  const uint base_pin;
+  const uint pin_count;
+  const struct SequencerRule rules[SEQUENCER_GROUP_RULES];
+  uint sm;
+  uint dma_chan;
+  enum SequencerPatternIndex playing;
+  uint32_t ring[SEQUENCER_MAX_KEYFRAMES] __attribute__((aligned(SEQUENCER_MAX_KEYFRAMES * sizeof(uint32_t))));
+};
+
+#define SEQUENCER_GROUP_INDEX_OF_PROFILE(name, base_pin_, pin_count_, rules_) SEQUENCER_GROUP_##name,
+
+enum SequencerGroupIndex {
+  PROFILE_SEQUENCER_GROUPS(SEQUENCER_GROUP_INDEX_OF_PROFILE, PROFILE_NO_RULE)
+  SEQUENCER_GROUP_COUNT,
+};
+
+#define SEQUENCER_RULE_OF_PROFILE(bits_, pattern_) { .bits = (bits_), .pattern = SEQUENCER_##pattern_ },
+#define SEQUENCER_GROUP_OF_PROFILE(name, base_pin_, pin_count_, rules_) \
+  [SEQUENCER_GROUP_##name] = { .base_pin = (base_pin_), .pin_count = (pin_count_), .rules = { rules_ } },
+
+static struct SequencerGroup SEQUENCER_GROUPS[SEQUENCER_GROUP_COUNT] = {
+  PROFILE_SEQUENCER_GROUPS(SEQUENCER_GROUP_OF_PROFILE, SEQUENCER_RULE_OF_PROFILE)
+};
+
+static uint sequencer_offset;
+
+static enum SequencerPatternIndex RCLIGHTS_HOT_FUNC(sequencer_group_pattern)(const struct SequencerGroup* group, uint8_t state) {
+  for (int i = 0; i < SEQUENCER_GROUP_RULES; i++) {
+    const struct SequencerRule* rule = &group->rules[i];
+
+    if (rule->bits && (state & rule->bits) == rule->bits) {
+      return rule->pattern;
+    }
+  }
+
+  return SEQUENCER_OFF;
+}
+
+/* The following function stops the group, copies the pattern to its
+   ring and starts it over from the first keyframe.  DMA reads the
+   ring wrapping at a power of two, so the pattern is padded with
+   keyframes that keep the pins of its last one for 3 microseconds
+   each. */
+static void RCLIGHTS_HOT_FUNC(play_sequencer_pattern)(struct SequencerGroup* group, enum SequencerPatternIndex index) {
+  const struct SequencerPattern* pattern = &SEQUENCER_PATTERNS[index];
+  uint ring_size = 1;
+  uint ring_bits = 2; // in bytes
+
+  while (ring_size < pattern->count) {
+    ring_size <<= 1;
+    ring_bits++;
+  }
+
+  dma_channel_abort(group->dma_chan);
+  pio_sm_set_enabled(SEQUENCER_PIO, group->sm, false);
+  pio_sm_clear_fifos(SEQUENCER_PIO, group->sm);
+  pio_sm_restart(SEQUENCER_PIO, group->sm);
+  pio_sm_exec(SEQUENCER_PIO, group->sm, pio_encode_jmp(sequencer_offset));
+
+  for (uint i = 0; i < ring_size; i++) {
+    group->ring[i] = i < pattern->count
+      ? pattern->keyframes[i]
+      : SEQUENCER_KEYFRAME_PINS(pattern->keyframes[pattern->count - 1]);
+  }
+
+  dma_channel_config config = dma_channel_get_default_config(group->dma_chan);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, false);
+  channel_config_set_ring(&config, false, ring_bits);
+  channel_config_set_dreq(&config, pio_get_dreq(SEQUENCER_PIO, group->sm, true));
+  dma_channel_configure(group->dma_chan, &config, &SEQUENCER_PIO->txf[group->sm], group->ring,
+                        SEQUENCER_DMA_TRANSFERS, true);
+
+  pio_sm_set_enabled(SEQUENCER_PIO, group->sm, true);
+  group->playing = index;
+}
+
+void init_sequencer() {
+  for (int p = 0; p < SEQUENCER_PATTERN_COUNT; p++) {
+    assert(SEQUENCER_PATTERNS[p].count > 0 && SEQUENCER_PATTERNS[p].count <= SEQUENCER_MAX_KEYFRAMES);
+  }
+
+  sequencer_offset = pio_add_program(SEQUENCER_PIO, &pattern_sequencer_program);
+
+  for (int g = 0; g < SEQUENCER_GROUP_COUNT; g++) {
+    struct SequencerGroup* group = &SEQUENCER_GROUPS[g];
+
+    group->sm = pio_claim_unused_sm(SEQUENCER_PIO, true);
+    group->dma_chan = dma_claim_unused_channel(true);
+
+    pattern_sequencer_program_init(SEQUENCER_PIO, group->sm, sequencer_offset, group->base_pin, group->pin_count,
+                                   SYS_CLK_DIV_TO_1MHZ);
+    play_sequencer_pattern(group, SEQUENCER_OFF);
+  }
+}
+
+void RCLIGHTS_HOT_FUNC(sequence_master_lights_state)(uint8_t state) {
+  for (int g = 0; g < SEQUENCER_GROUP_COUNT; g++) {
+    struct SequencerGroup* group = &SEQUENCER_GROUPS[g];
+    const enum SequencerPatternIndex pattern = sequencer_group_pattern(group, state);
+
+    if (pattern != group->playing) {
+      play_sequencer_pattern(group, pattern);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,37 @@
+// ********************************************************************************
+// Pattern sequencer
+//
+// With RCLIGHTS_SEQUENCER set to 1, groups of outputs beyond the six
+// leds play light patterns, such as strobes and sequential turn
+// signals, selected by bits of the master lights state.  A pattern is
+// a table of keyframes, each holding the levels of the pins of the
+// group and how long they last.  Each group runs its pattern on a PIO
+// state machine that a DMA channel feeds from a ring over the table,
+// so once a pattern is selected it plays without the CPU.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_SEQUENCER_H
+#define RCLIGHTS_SEQUENCER_H
+
+#include <stdint.h>
+
+#ifndef RCLIGHTS_SEQUENCER
+#define RCLIGHTS_SEQUENCER 0
+#endif
+
+#if RCLIGHTS_SEQUENCER
+
+void init_sequencer();
+
+/* Plays, on every group, the pattern the state selects.  A group
+   whose pattern does not change keeps playing undisturbed. */
+void sequence_master_lights_state(uint8_t state);
+
+#else
+
+static inline void init_sequencer() {}
+static inline void sequence_master_lights_state(uint8_t state) {}
+
+#endif
+
+#endif
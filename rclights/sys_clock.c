@@ -0,0 +1,24 @@
+// ********************************************************************************
+// System clock profiles
+// ********************************************************************************
+
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
+#include "sys_clock.h"
+
+#define SYS_CLOCK_VREG_SETTLE_US 1000 // the regulator output settles well within this
+
+void init_sys_clock() {
+#if SYS_CLOCK_PROFILE == SYS_CLOCK_LOW_POWER
+  set_sys_clock_48mhz();
+#elif SYS_CLOCK_PROFILE == SYS_CLOCK_HIGH_RES
+  vreg_set_voltage(VREG_VOLTAGE_1_15);
+  busy_wait_us(SYS_CLOCK_VREG_SETTLE_US);
+  set_sys_clock_khz(SYS_CLK_KHZ, true);
+#else
+  /* Set even though it is the boot clock of the SDK this was written
+     for, so that the timing constants hold whatever the SDK boots
+     with. */
+  set_sys_clock_khz(SYS_CLK_KHZ, true);
+#endif
+}
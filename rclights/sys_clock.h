@@ -0,0 +1,47 @@
+// ********************************************************************************
+// System clock profiles
+// ********************************************************************************
+
+#ifndef RCLIGHTS_SYS_CLOCK_H
+#define RCLIGHTS_SYS_CLOCK_H
+
+#include "pico/stdlib.h"
+
+/* System clock profiles.  LOW_POWER runs the system clock at 48 MHz
+   off the USB PLL and stops the system PLL.  DEFAULT runs it at the
+   125 MHz the timing constants were written for.  HIGH_RES runs it at
+   250 MHz with the core voltage raised, for the capture modes that
+   count system clock cycles.  Every divider that depends on the
+   system clock derives from SYS_CLK_KHZ at compile time. */
+#define SYS_CLOCK_LOW_POWER 0
+#define SYS_CLOCK_DEFAULT 1
+#define SYS_CLOCK_HIGH_RES 2
+
+#ifndef SYS_CLOCK_PROFILE
+#define SYS_CLOCK_PROFILE SYS_CLOCK_DEFAULT
+#endif
+
+#if SYS_CLOCK_PROFILE == SYS_CLOCK_LOW_POWER
+#define SYS_CLK_KHZ 48000
+#elif SYS_CLOCK_PROFILE == SYS_CLOCK_DEFAULT
+#define SYS_CLK_KHZ 125000
+#elif SYS_CLOCK_PROFILE == SYS_CLOCK_HIGH_RES
+#define SYS_CLK_KHZ 250000
+#else
+#error "Unknown SYS_CLOCK_PROFILE"
+#endif
+
+static const uint32_t SYS_CLK_FREQ = SYS_CLK_KHZ * 1000;
+
+/* Divides the system clock down to 1 MHz, so that a PWM slice counts
+   one cycle per microsecond: 125 at the default clock.  PWM dividers
+   stop short of 256. */
+#define SYS_CLK_DIV_TO_1MHZ (SYS_CLK_KHZ / 1000.0f)
+
+_Static_assert(SYS_CLK_KHZ / 1000 < 256, "system clock too fast to divide down to 1 MHz on a PWM slice");
+
+/* Switches the system clock to the profile.  Must run first thing
+   in main(), before any peripheral derives a rate from a clock. */
+void init_sys_clock();
+
+#endif
@@ -0,0 +1,196 @@
+// ********************************************************************************
+// Telemetry
+// ********************************************************************************
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "telemetry.h"
+#include "input_capture.h"
+#include "master_state.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_TELEMETRY
+
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+
+#define TELEMETRY_RING_SIZE 64 // must be a power of two
+
+/* Single producer, the core that decodes the input, and single
+   consumer, the main loop of core 0.  Each index is written only by
+   its side. */
+static struct TelemetryFrame telemetry_ring[TELEMETRY_RING_SIZE];
+static volatile uint32_t telemetry_head = 0;
+static volatile uint32_t telemetry_tail = 0;
+static volatile uint32_t telemetry_dropped = 0;
+
+/* Latest signal change, written by the decoding core.  The count
+   is written last, so a new count means the rest is in place. */
+static volatile uint32_t telemetry_signal_events = 0;
+static volatile uint32_t telemetry_signal_us = 0;
+static volatile bool telemetry_signal_lost = false;
+
+/* Boot times, written once by the decoding core.  The flag is
+   written last. */
+static uint32_t telemetry_boot_lights_us = 0;
+static uint32_t telemetry_boot_first_state_us = 0;
+static volatile bool telemetry_boot_pending = false;
+
+static uint32_t telemetry_frame_count = 0;
+static uint16_t telemetry_seq = 0;
+
+void RCLIGHTS_HOT_FUNC(telemetry_note_frame)(hi_us_t smooth_hi_us, uint8_t master_lights_state) {
+  if (input_frame_count == telemetry_frame_count) {
+    return;
+  }
+
+  telemetry_frame_count = input_frame_count;
+
+  const uint32_t head = telemetry_head;
+  const uint16_t seq = telemetry_seq++;
+
+  if (head - telemetry_tail >= TELEMETRY_RING_SIZE) {
+    telemetry_dropped++;
+    return;
+  }
+
+  struct TelemetryFrame* frame = &telemetry_ring[head & (TELEMETRY_RING_SIZE - 1)];
+
+  frame->sync = TELEMETRY_SYNC;
+  frame->type = TELEMETRY_FRAME;
+  frame->seq = seq;
+  frame->tail_us = input_pwm_tail_us;
+  frame->raw_hi_us = TELEMETRY_HI_US(input_frame_hi_us);
+  frame->smooth_hi_us = TELEMETRY_HI_US(smooth_hi_us);
+  frame->state_id = input_pwm_hi_us_to_master_state_id(smooth_hi_us);
+  frame->master_lights_state = master_lights_state;
+
+  __dmb();
+  telemetry_head = head + 1;
+}
+
+void RCLIGHTS_HOT_FUNC(telemetry_note_signal)(bool lost) {
+  telemetry_signal_us = time_us_32();
+  telemetry_signal_lost = lost;
+
+  __dmb();
+  telemetry_signal_events++;
+}
+
+void telemetry_note_boot(uint32_t lights_us, uint32_t first_state_us) {
+  telemetry_boot_lights_us = lights_us;
+  telemetry_boot_first_state_us = first_state_us;
+
+  __dmb();
+  telemetry_boot_pending = true;
+}
+
+/* Records go out through the stdio driver, which serialises them with
+   printf and with the USB task of stdio_usb, so they never interleave
+   with other output.  Only the free space of the CDC buffer is read
+   from TinyUSB directly; should other output take it meanwhile, the
+   driver waits for the host rather than dropping bytes. */
+static inline bool telemetry_fits(uint32_t size) {
+  return tud_cdc_write_available() >= size;
+}
+
+static inline void telemetry_write(const void* record, uint32_t size) {
+  stdio_put_string((const char*)record, size, false, false);
+}
+
+void RCLIGHTS_HOT_FUNC(telemetry_drain)() {
+  static uint32_t reported_dropped = 0;
+  static uint32_t reported_signal_events = 0;
+
+  if (!stdio_usb_connected()) {
+    telemetry_tail = telemetry_head; // nobody listens, keep the ring from filling up
+    return;
+  }
+
+  const uint32_t dropped = telemetry_dropped;
+
+  if (dropped != reported_dropped && telemetry_fits(sizeof(struct TelemetryStatus))) {
+    struct TelemetryStatus status = {
+      .sync = TELEMETRY_SYNC,
+      .type = TELEMETRY_STATUS,
+      .us = time_us_32(),
+      .dropped = dropped,
+    };
+
+    telemetry_write(&status, sizeof(status));
+    reported_dropped = dropped;
+  }
+
+  if (telemetry_boot_pending && telemetry_fits(sizeof(struct TelemetryBoot))) {
+    __dmb();
+
+    struct TelemetryBoot boot = {
+      .sync = TELEMETRY_SYNC,
+      .type = TELEMETRY_BOOT,
+      .lights_us = telemetry_boot_lights_us,
+      .first_state_us = telemetry_boot_first_state_us,
+    };
+
+    telemetry_write(&boot, sizeof(boot));
+    telemetry_boot_pending = false;
+  }
+
+  const uint32_t signal_events = telemetry_signal_events;
+
+  if (signal_events != reported_signal_events && telemetry_fits(sizeof(struct TelemetrySignal))) {
+    __dmb();
+
+    struct TelemetrySignal signal = {
+      .sync = TELEMETRY_SYNC,
+      .type = TELEMETRY_SIGNAL,
+      .us = telemetry_signal_us,
+      .events = signal_events,
+      .lost = telemetry_signal_lost,
+    };
+
+    telemetry_write(&signal, sizeof(signal));
+    reported_signal_events = signal_events;
+  }
+
+#if RCLIGHTS_METRICS
+  static uint32_t reported_metrics_seconds[METRICS_CORES];
+
+  for (uint32_t core = 0; core < METRICS_CORES; core++) {
+    struct MetricsCore counts;
+
+    if (rclights_metrics.cores[core].seconds != reported_metrics_seconds[core]
+        && telemetry_fits(sizeof(struct TelemetryMetrics))
+        && metrics_copy_core(core, &counts)) {
+      struct TelemetryMetrics metrics = {
+        .sync = TELEMETRY_SYNC,
+        .type = TELEMETRY_METRICS,
+        .core = core,
+        .seconds = counts.seconds,
+        .iterations_per_sec = counts.iterations_per_sec,
+        .iteration_us_max = counts.iteration_us_max,
+        .busy_cycles_max = counts.busy_cycles_max,
+      };
+
+      memcpy(metrics.stage_cycles_per_sec, counts.stage_cycles_per_sec, sizeof(metrics.stage_cycles_per_sec));
+      memcpy(metrics.stage_cycles_max, counts.stage_cycles_max, sizeof(metrics.stage_cycles_max));
+
+      telemetry_write(&metrics, sizeof(metrics));
+      reported_metrics_seconds[core] = counts.seconds;
+    }
+  }
+#endif
+
+  uint32_t tail = telemetry_tail;
+  const uint32_t head = telemetry_head;
+
+  while (tail != head && telemetry_fits(sizeof(struct TelemetryFrame))) {
+    telemetry_write(&telemetry_ring[tail & (TELEMETRY_RING_SIZE - 1)], sizeof(struct TelemetryFrame));
+    tail++;
+  }
+
+  __dmb();
+  telemetry_tail = tail;
+}
+
+#endif
@@ -0,0 +1,117 @@
+// ********************************************************************************
+// Telemetry
+//
+// With RCLIGHTS_TELEMETRY set to 1, every input frame produces a
+// compact binary record in a RAM ring buffer, and the main loop
+// drains the ring to USB stdio only as far as the USB buffer has room.
+// Nothing waits for the host: when the ring is full the record is
+// counted as dropped instead, and the count goes out in a status
+// record.  Every record starts with TELEMETRY_SYNC and a type so a
+// host can find record boundaries in the byte stream.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_TELEMETRY_H
+#define RCLIGHTS_TELEMETRY_H
+
+#include "input_pwm.h"
+#include "metrics.h"
+
+#ifndef RCLIGHTS_TELEMETRY
+#define RCLIGHTS_TELEMETRY 0
+#endif
+
+#define TELEMETRY_SYNC 0xa5
+
+enum TelemetryRecordType {
+  TELEMETRY_FRAME = 1,
+  TELEMETRY_STATUS = 2,
+  TELEMETRY_SIGNAL = 3,
+  TELEMETRY_BOOT = 4,
+  TELEMETRY_METRICS = 5,
+};
+
+/* Pulse widths are sent in sixteenths of a microsecond, whatever
+   hi_us_t is. */
+#if INPUT_PWM_FLOAT
+#define TELEMETRY_HI_US(hi_us) ((int32_t)((hi_us) * 16))
+#else
+#define TELEMETRY_HI_US(hi_us) ((int32_t)(hi_us) << (4 - HI_US_FRAC_BITS))
+#endif
+
+struct __attribute__((packed)) TelemetryFrame {
+  uint8_t sync;
+  uint8_t type;
+  uint16_t seq;          // increments on every frame, so the host sees gaps
+  uint32_t tail_us;      // end of the input pulse, time_us_32() microseconds
+  int32_t raw_hi_us;     // as measured
+  int32_t smooth_hi_us;  // as filtered
+  uint8_t state_id;
+  uint8_t master_lights_state;
+};
+
+struct __attribute__((packed)) TelemetryStatus {
+  uint8_t sync;
+  uint8_t type;
+  uint32_t us;
+  uint32_t dropped;      // frames dropped since boot
+};
+
+/* Sent when the signal is lost or comes back, see failsafe.h.  Only
+   the latest change goes out; events counts every change since boot,
+   so the host sees the ones it missed. */
+struct __attribute__((packed)) TelemetrySignal {
+  uint8_t sync;
+  uint8_t type;
+  uint32_t us;           // time of the change, time_us_32() microseconds
+  uint32_t events;
+  uint8_t lost;
+};
+
+/* Sent once per boot, as soon as a host listens, with the times from
+   power-on to the boot lights and to the first valid decode. */
+struct __attribute__((packed)) TelemetryBoot {
+  uint8_t sync;
+  uint8_t type;
+  uint32_t lights_us;
+  uint32_t first_state_us;
+};
+
+/* Sent once a second per core with RCLIGHTS_METRICS, with the
+   counts published to rclights_metrics, see metrics.h. */
+struct __attribute__((packed)) TelemetryMetrics {
+  uint8_t sync;
+  uint8_t type;
+  uint8_t core;
+  uint32_t seconds;
+  uint32_t iterations_per_sec;
+  uint32_t iteration_us_max;
+  uint32_t busy_cycles_max;
+  uint32_t stage_cycles_per_sec[METRICS_STAGE_COUNT];
+  uint32_t stage_cycles_max[METRICS_STAGE_COUNT];
+};
+
+#if RCLIGHTS_TELEMETRY
+
+/* Records the latest input frame, if it is new, along with what the
+   filter and the decoder made of it. */
+void telemetry_note_frame(hi_us_t smooth_hi_us, uint8_t master_lights_state);
+
+/* Records a change of the signal, lost or back. */
+void telemetry_note_signal(bool lost);
+
+/* Records the boot times, see struct TelemetryBoot. */
+void telemetry_note_boot(uint32_t lights_us, uint32_t first_state_us);
+
+/* Writes as many whole records as the USB buffer takes right now. */
+void telemetry_drain();
+
+#else
+
+static inline void telemetry_note_frame(hi_us_t smooth_hi_us, uint8_t master_lights_state) {}
+static inline void telemetry_note_signal(bool lost) {}
+static inline void telemetry_note_boot(uint32_t lights_us, uint32_t first_state_us) {}
+static inline void telemetry_drain() {}
+
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+// ********************************************************************************
+// Trace recording
+// ********************************************************************************
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "trace_record.h"
+#include "failsafe.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_TRACE_RECORD
+
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+
+#ifndef RCLIGHTS_DUAL_CORE
+#define RCLIGHTS_DUAL_CORE 0
+#endif
+
+_Static_assert((TRACE_RECORD_FRAMES & (TRACE_RECORD_FRAMES - 1)) == 0, "TRACE_RECORD_FRAMES must be a power of two");
+
+/* Header and records rounded up to whole sectors, right below the
+   calibration sector at the end of flash. */
+#define TRACE_FLASH_SIZE \
+  ((sizeof(struct TraceRecordHeader) + TRACE_RECORD_FRAMES * sizeof(uint32_t) + FLASH_SECTOR_SIZE - 1) \
+   / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE)
+#define TRACE_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE - TRACE_FLASH_SIZE)
+
+#define TRACE_HEADER_WORDS (sizeof(struct TraceRecordHeader) / sizeof(uint32_t))
+#define TRACE_PAGE_WORDS (FLASH_PAGE_SIZE / sizeof(uint32_t))
+
+/* Single producer, the core that decodes.  The count of records
+   written since boot is written after the record.  While a dump or a
+   save reads the ring, the producer is frozen out of it. */
+static uint32_t trace_ring[TRACE_RECORD_FRAMES];
+static volatile uint32_t trace_count = 0;
+static volatile bool trace_frozen = false;
+
+static uint32_t trace_frame_count = 0;
+static uint32_t trace_last_ms = 0;
+
+/* Records taken out of the ring by a dump or a save, see
+   freeze_trace_ring(). */
+static uint32_t trace_first = 0;
+static uint32_t trace_end = 0;
+
+/* Dump in progress, of records trace_dump_next to trace_end.
+   trace_dump_ms is the time of the record before trace_dump_next. */
+static bool trace_dumping = false;
+static bool trace_dump_header_sent = false;
+static uint32_t trace_dump_next = 0;
+static uint32_t trace_dump_ms = 0;
+
+static uint32_t RCLIGHTS_HOT_FUNC(trace_record_hi_16ths)(hi_us_t hi_us) {
+#if INPUT_PWM_FLOAT
+  const int32_t hi_16ths = hi_us * 16;
+#else
+  const int32_t hi_16ths = hi_us << (4 - HI_US_FRAC_BITS);
+#endif
+
+  if (hi_16ths < 0) {
+    return 0;
+  }
+
+  return hi_16ths > TRACE_RECORD_MAX_HI_16THS ? TRACE_RECORD_MAX_HI_16THS : hi_16ths;
+}
+
+void RCLIGHTS_HOT_FUNC(trace_record_note_frame)(uint8_t master_lights_state) {
+  if (input_frame_count == trace_frame_count || trace_frozen) {
+    return;
+  }
+
+  trace_frame_count = input_frame_count;
+
+  const uint32_t now_ms = time_us_32() / 1000;
+  const uint32_t ms = now_ms - trace_last_ms;
+  const uint32_t count = trace_count;
+
+  trace_last_ms = now_ms;
+  trace_ring[count & (TRACE_RECORD_FRAMES - 1)] =
+    TRACE_RECORD(trace_record_hi_16ths(input_frame_hi_us), master_lights_state,
+                 ms > TRACE_RECORD_MAX_MS ? TRACE_RECORD_MAX_MS : ms);
+
+  __dmb();
+  trace_count = count + 1;
+}
+
+/* The following function stops the recording and takes the records
+   in the ring.  The producer may be writing one more record as the
+   freeze lands, into the slot of the oldest one, so a full ring
+   gives up its oldest record. */
+static void freeze_trace_ring() {
+  trace_frozen = true;
+  __dmb();
+
+  trace_end = trace_count;
+  trace_first = trace_end > TRACE_RECORD_FRAMES - 1 ? trace_end - (TRACE_RECORD_FRAMES - 1) : 0;
+}
+
+static void thaw_trace_ring() {
+  __dmb();
+  trace_frozen = false;
+}
+
+static uint32_t trace_word(uint32_t index) {
+  if (index >= TRACE_HEADER_WORDS) {
+    return trace_ring[(trace_first + index - TRACE_HEADER_WORDS) & (TRACE_RECORD_FRAMES - 1)];
+  }
+
+  struct TraceRecordHeader header = {
+    .magic = TRACE_RECORD_MAGIC,
+    .count = trace_end - trace_first,
+    .reserved = 0,
+  };
+
+  header.check = trace_record_check(&header);
+
+  return ((const uint32_t*)&header)[index];
+}
+
+/* A sector erase takes 45 ms typically and up to 400 ms, programming
+   its 16 pages up to 48 ms more. */
+#define TRACE_SAVE_WATCHDOG_MS 500
+
+/* The following function writes the header and the records to the
+   trace region, one sector at a time.  Erasing and programming stall
+   the flash, so nothing may run from it meanwhile: interrupts stay
+   disabled for each sector, which stops every capture interrupt and
+   timer on the calling core, and core 1, if running, waits in RAM
+   with its own interrupts disabled.  Without RCLIGHTS_DUAL_CORE the
+   loop that decodes is the caller, so it stops all the same.  A
+   sector can outlast FAILSAFE_WATCHDOG_MS, so the watchdog gets
+   TRACE_SAVE_WATCHDOG_MS and is fed between sectors. */
+static void save_trace_ring() {
+  const uint32_t words = TRACE_HEADER_WORDS + trace_end - trace_first;
+  uint32_t page[TRACE_PAGE_WORDS];
+
+  failsafe_stretch_watchdog(TRACE_SAVE_WATCHDOG_MS);
+
+#if RCLIGHTS_DUAL_CORE
+  multicore_lockout_start_blocking();
+#endif
+
+  for (uint32_t sector = 0; sector * FLASH_SECTOR_SIZE < words * sizeof(uint32_t); sector++) {
+    const uint32_t offset = TRACE_FLASH_OFFSET + sector * FLASH_SECTOR_SIZE;
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+
+    for (uint32_t p = 0; p < FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE; p++) {
+      const uint32_t first_word = (sector * FLASH_SECTOR_SIZE + p * FLASH_PAGE_SIZE) / sizeof(uint32_t);
+
+      for (uint32_t w = 0; w < TRACE_PAGE_WORDS; w++) {
+        page[w] = first_word + w < words ? trace_word(first_word + w) : 0xffffffff;
+      }
+
+      flash_range_program(offset + p * FLASH_PAGE_SIZE, (const uint8_t*)page, FLASH_PAGE_SIZE);
+    }
+
+    restore_interrupts(interrupts);
+    watchdog_update();
+  }
+
+#if RCLIGHTS_DUAL_CORE
+  multicore_lockout_end_blocking();
+#endif
+
+  failsafe_restore_watchdog();
+}
+
+void trace_record_handle_command(int command) {
+  if (trace_dumping) {
+    return;
+  }
+
+  switch (command) {
+  case TRACE_RECORD_DUMP_COMMAND:
+    freeze_trace_ring();
+    trace_dump_next = trace_first;
+    trace_dump_ms = 0;
+    trace_dump_header_sent = false;
+    trace_dumping = true;
+    break;
+  case TRACE_RECORD_SAVE_COMMAND:
+    freeze_trace_ring();
+    save_trace_ring();
+    thaw_trace_ring();
+    break;
+  default:
+    break;
+  }
+}
+
+/* Lines are in the trace file format of the bench: the width in
+   microseconds and the state it decoded to, followed by the time in
+   milliseconds since the first record, which the bench ignores.
+   They go out through the stdio driver, like telemetry, so they never
+   interleave with other output; only the free space of the CDC
+   buffer is read from TinyUSB, to write no more than fits. */
+void RCLIGHTS_HOT_FUNC(trace_record_drain)() {
+  if (!trace_dumping) {
+    return;
+  }
+
+  if (!stdio_usb_connected()) {
+    trace_dumping = false; // nobody listens, resume recording
+    thaw_trace_ring();
+    return;
+  }
+
+  char line[40];
+  int length;
+
+  if (!trace_dump_header_sent) {
+    length = snprintf(line, sizeof(line), "# rclights trace, %lu frames\n",
+                      (unsigned long)(trace_end - trace_first));
+
+    if (tud_cdc_write_available() < length) {
+      return;
+    }
+
+    stdio_put_string(line, length, false, false);
+    trace_dump_header_sent = true;
+  }
+
+  while (trace_dump_next != trace_end) {
+    const uint32_t record = trace_ring[trace_dump_next & (TRACE_RECORD_FRAMES - 1)];
+    const uint32_t hi_16ths = TRACE_RECORD_HI_16THS(record);
+    const uint32_t ms = trace_dump_next == trace_first ? 0 : trace_dump_ms + TRACE_RECORD_MS(record);
+
+    length = snprintf(line, sizeof(line), "%lu.%04lu %u %lu\n",
+                      (unsigned long)(hi_16ths >> 4), (unsigned long)((hi_16ths & 15) * 625),
+                      (unsigned)TRACE_RECORD_STATE(record), (unsigned long)ms);
+
+    if (tud_cdc_write_available() < length) {
+      break;
+    }
+
+    stdio_put_string(line, length, false, false);
+    trace_dump_ms = ms;
+    trace_dump_next++;
+  }
+
+  if (trace_dump_next == trace_end) {
+    trace_dumping = false;
+    thaw_trace_ring();
+  }
+}
+
+#endif
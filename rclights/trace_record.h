@@ -0,0 +1,87 @@
+// ********************************************************************************
+// Trace recording
+//
+// With RCLIGHTS_TRACE_RECORD set to 1, every input frame leaves a 32
+// bit record in a RAM ring: the raw pulse width, the master lights
+// state it decoded to and the milliseconds since the frame before.
+// The ring keeps the newest TRACE_RECORD_FRAMES frames, minutes at
+// 62 Hz, so after a driver reports wrong lights the input that led
+// to them is still there.  On request over USB stdio the ring is
+// dumped as text in the trace file format of the bench, or saved to
+// a flash region below the calibration sector, and the bench replays
+// either through the same filters and decoder, see bench/trace_file.c.
+//
+// The record format below does not depend on the Pico SDK, so the
+// bench reads it too.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_TRACE_RECORD_H
+#define RCLIGHTS_TRACE_RECORD_H
+
+#include "input_pwm.h"
+
+#ifndef RCLIGHTS_TRACE_RECORD
+#define RCLIGHTS_TRACE_RECORD 0
+#endif
+
+#ifndef TRACE_RECORD_FRAMES
+#define TRACE_RECORD_FRAMES 16384 // must be a power of two, 64 KB of RAM and over 4 minutes at 62 Hz
+#endif
+
+/* Bits 0 to 15 hold the width in sixteenths of a microsecond, up to
+   4095.9375, bits 16 to 21 the master lights state and bits 22 to 31
+   the milliseconds since the frame before, TRACE_RECORD_MAX_MS when
+   longer, as across a loss of signal. */
+#define TRACE_RECORD_MAX_HI_16THS 0xffff
+#define TRACE_RECORD_MAX_MS 1023
+
+#define TRACE_RECORD(hi_16ths, state, ms) \
+  ((uint32_t)(hi_16ths) | ((uint32_t)(state) & 0x3f) << 16 | (uint32_t)(ms) << 22)
+#define TRACE_RECORD_HI_16THS(record) ((record) & 0xffff)
+#define TRACE_RECORD_STATE(record) (((record) >> 16) & 0x3f)
+#define TRACE_RECORD_MS(record) ((record) >> 22)
+
+/* A saved trace is this header followed by count records, oldest
+   first. */
+#define TRACE_RECORD_MAGIC 0x52435431 // "RCT1"
+
+struct TraceRecordHeader {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t reserved;
+  uint32_t check; // guards against a trace torn by a power cut
+};
+
+static inline uint32_t trace_record_check(const struct TraceRecordHeader* header) {
+  return ~(header->magic ^ header->count);
+}
+
+#if RCLIGHTS_TRACE_RECORD
+
+/* Records the latest input frame, if it is new, with the state it
+   decoded to.  Called on the core that decodes. */
+void trace_record_note_frame(uint8_t master_lights_state);
+
+#define TRACE_RECORD_DUMP_COMMAND 't'
+#define TRACE_RECORD_SAVE_COMMAND 'w'
+
+/* Handles a command character read from stdio: 't' dumps the ring
+   over USB and 'w' saves it to flash.  Others are ignored.  A save
+   stalls the calling loop, and with RCLIGHTS_DUAL_CORE core 1, for
+   about a second, so the input is neither captured nor decoded
+   meanwhile; the caller shows the failsafe state before it. */
+void trace_record_handle_command(int command);
+
+/* Writes as much of a requested dump as the USB buffer takes right
+   now. */
+void trace_record_drain();
+
+#else
+
+static inline void trace_record_note_frame(uint8_t master_lights_state) {}
+static inline void trace_record_handle_command(int command) {}
+static inline void trace_record_drain() {}
+
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+// ********************************************************************************
+// Vehicle profiles
+//
+// A profile declares one vehicle: the bits of the master lights state,
+// the led levels, the blink groups, the leds with their pins and
+// rules, the sequencer groups, the pin and pixel map of the WS2812
+// strip and the rules that map receiver channels to the state.  It is a header of
+// plain macros in profiles/, selected at build time with
+// RCLIGHTS_PROFILE_HEADER.  The modules expand those macros into
+// constant tables: light_rules.c into the levels and blink masks of
+// every master lights state, leds.c into the leds and blink groups,
+// sequencer.c into the sequencer groups, ws2812.c into the pixel map
+// and rc_channels.c into the channel rules.  Nothing is interpreted at run time
+// and the hot path stays the same loops over constant tables.
+//
+// A profile defines:
+//
+// * BRAKE_LIGHT_BIT, REVERSE_LIGHT_BIT, LEFT_BLINK_BIT,
+//   RIGHT_BLINK_BIT, HI_BEAMS_BIT and DAY_NIGHT_BIT, one distinct bit
+//   each out of the low 6.  The state layouts of master_state.h put
+//   the three brake and reverse settings in bits 0 and 1.
+// * PROFILE_ON_LEVEL and PROFILE_HI_LEVEL, out of OUTPUT_PWM_MAX_LEVEL.
+// * PROFILE_BLINK_GROUPS(GROUP), one GROUP(name, interval_us) per
+//   blink group.
+// * PROFILE_LEDS(LED, arg), one
+//   LED(arg, name, pin, base, on_bits, blink_bits, hi_bits, blink_group)
+//   per led, at most 8, with the fields of struct LedRule.  Every
+//   expansion passes its own arg through.
+// * PROFILE_SEQUENCER_GROUPS(GROUP, RULE), one
+//   GROUP(name, base_pin, pin_count, rules) per group of consecutive
+//   pins, where rules is up to two RULE(bits, pattern), the pattern
+//   named without its SEQUENCER_ prefix, see sequencer.c.  Only
+//   needed with RCLIGHTS_SEQUENCER.
+// * PROFILE_WS2812_PIN, PROFILE_PIXEL_COUNT and
+//   PROFILE_PIXEL_RANGES(RANGE), one RANGE(led, first, count, rgb)
+//   per range, see ws2812.c.  Only needed with RCLIGHTS_WS2812.
+// * PROFILE_RC_CHANNEL_RULES(RULE) for receivers that send all their
+//   channels and PROFILE_RC_SERVO_CHANNEL_RULES(RULE) for servo
+//   outputs wired one per pin, one RULE(bits, channel, min_us, max_us)
+//   per rule, see rc_channels.h.
+//
+// The pins of the leds, the sequencer groups and the strip must all
+// differ, and stay clear of the pins the board wiring takes whatever
+// the profile, PROFILE_BOARD_PIN_MASK; the build fails otherwise.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_VEHICLE_PROFILE_H
+#define RCLIGHTS_VEHICLE_PROFILE_H
+
+#ifndef RCLIGHTS_PROFILE_HEADER
+#define RCLIGHTS_PROFILE_HEADER "profiles/blog_car.h"
+#endif
+
+#include RCLIGHTS_PROFILE_HEADER
+
+#define PROFILE_STATE_BITS \
+  (BRAKE_LIGHT_BIT | REVERSE_LIGHT_BIT | LEFT_BLINK_BIT | RIGHT_BLINK_BIT | HI_BEAMS_BIT | DAY_NIGHT_BIT)
+
+_Static_assert(PROFILE_STATE_BITS == 0x3f, "profile state bits must be distinct bits out of the low 6");
+_Static_assert((BRAKE_LIGHT_BIT | REVERSE_LIGHT_BIT) == 0x03, "profile brake and reverse bits must be bits 0 and 1");
+
+/* GPIO 3 for calibration, see calibration.h, 5 for the serial
+   receiver, see input_serial.c, and 27, 26, 19 and 16 for the PWM
+   inputs, see input_capture.c and input_pio.c. */
+#define PROFILE_BOARD_PIN_MASK ((1ull << 3) | (1ull << 5) | (1ull << 16) | (1ull << 19) | (1ull << 26) | (1ull << 27))
+
+/* Each pin of the profile as a bit, once ORed together and once
+   added up: the two only match when no pin is taken twice. */
+#define PROFILE_LED_PIN_OR(arg, name, pin, ...) | (1ull << (pin))
+#define PROFILE_LED_PIN_SUM(arg, name, pin, ...) + (1ull << (pin))
+#define PROFILE_SEQUENCER_PINS(base_pin, pin_count) (((1ull << (pin_count)) - 1) << (base_pin))
+#define PROFILE_SEQUENCER_PIN_OR(name, base_pin, pin_count, rules) | PROFILE_SEQUENCER_PINS(base_pin, pin_count)
+#define PROFILE_SEQUENCER_PIN_SUM(name, base_pin, pin_count, rules) + PROFILE_SEQUENCER_PINS(base_pin, pin_count)
+#define PROFILE_NO_RULE(bits, pattern)
+
+#ifdef PROFILE_SEQUENCER_GROUPS
+#define PROFILE_SEQUENCER_PIN_MASK (0 PROFILE_SEQUENCER_GROUPS(PROFILE_SEQUENCER_PIN_OR, PROFILE_NO_RULE))
+#define PROFILE_SEQUENCER_PIN_TOTAL (0 PROFILE_SEQUENCER_GROUPS(PROFILE_SEQUENCER_PIN_SUM, PROFILE_NO_RULE))
+#else
+#define PROFILE_SEQUENCER_PIN_MASK 0ull
+#define PROFILE_SEQUENCER_PIN_TOTAL 0ull
+#endif
+
+#ifdef PROFILE_WS2812_PIN
+#define PROFILE_WS2812_PIN_MASK (1ull << (PROFILE_WS2812_PIN))
+#else
+#define PROFILE_WS2812_PIN_MASK 0ull
+#endif
+
+#define PROFILE_PIN_MASK \
+  ((0 PROFILE_LEDS(PROFILE_LED_PIN_OR, )) | PROFILE_SEQUENCER_PIN_MASK | PROFILE_WS2812_PIN_MASK)
+#define PROFILE_PIN_TOTAL \
+  ((0 PROFILE_LEDS(PROFILE_LED_PIN_SUM, )) + PROFILE_SEQUENCER_PIN_TOTAL + PROFILE_WS2812_PIN_MASK)
+
+_Static_assert(PROFILE_PIN_MASK == PROFILE_PIN_TOTAL, "profile pins of leds, sequencer groups and strip must differ");
+_Static_assert(PROFILE_PIN_MASK < (1ull << 30), "profile pins must be GPIO 0 to 29");
+_Static_assert(!(PROFILE_PIN_MASK & PROFILE_BOARD_PIN_MASK), "profile pins must stay clear of PROFILE_BOARD_PIN_MASK");
+
+/* The PWM slices the leds take and the count of sequencer groups,
+   which the DMA channels of the led fades and the sequencer go by. */
+#define PROFILE_LED_SLICE_OR(arg, name, pin, ...) | (1u << (((pin) >> 1) & 7))
+#define PROFILE_LED_SLICE_MASK (0 PROFILE_LEDS(PROFILE_LED_SLICE_OR, ))
+#define PROFILE_LED_SLICE_COUNT \
+  ((PROFILE_LED_SLICE_MASK & 1) + (PROFILE_LED_SLICE_MASK >> 1 & 1) + (PROFILE_LED_SLICE_MASK >> 2 & 1) + \
+   (PROFILE_LED_SLICE_MASK >> 3 & 1) + (PROFILE_LED_SLICE_MASK >> 4 & 1) + (PROFILE_LED_SLICE_MASK >> 5 & 1) + \
+   (PROFILE_LED_SLICE_MASK >> 6 & 1) + (PROFILE_LED_SLICE_MASK >> 7 & 1))
+
+#ifdef PROFILE_SEQUENCER_GROUPS
+#define PROFILE_SEQUENCER_GROUP_ONE(name, base_pin, pin_count, rules) + 1
+#define PROFILE_SEQUENCER_GROUP_COUNT (0 PROFILE_SEQUENCER_GROUPS(PROFILE_SEQUENCER_GROUP_ONE, PROFILE_NO_RULE))
+#else
+#define PROFILE_SEQUENCER_GROUP_COUNT 0
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+// ********************************************************************************
+// WS2812 strip output
+// ********************************************************************************
+
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "ws2812.h"
+#include "light_rules.h"
+#include "sys_clock.h"
+#include "hot_path.h"
+
+#if RCLIGHTS_WS2812
+
+#include "ws2812.pio.h"
+
+#if !defined(PROFILE_WS2812_PIN) || !defined(PROFILE_PIXEL_COUNT) || !defined(PROFILE_PIXEL_RANGES)
+#error "RCLIGHTS_WS2812 needs a vehicle profile with a strip pin and pixel map"
+#endif
+
+#define WS2812_PIO pio1 // pio0 may be taken by the PIO capture modes
+#define WS2812_PIN PROFILE_WS2812_PIN
+
+#define WS2812_PIXEL_COUNT PROFILE_PIXEL_COUNT
+
+/* 800 kbit/s and 24 bits per pixel.  The strip latches a frame once
+   the line has been low for the reset time, 280 microseconds for the
+   later WS2812B parts. */
+#define WS2812_BIT_HZ 800000
+#define WS2812_PIXEL_US 30
+#define WS2812_RESET_US 300
+#define WS2812_FRAME_US (WS2812_PIXEL_COUNT * WS2812_PIXEL_US + WS2812_RESET_US)
+
+static const float WS2812_CLK_DIV = SYS_CLK_KHZ * 1000.0f / (WS2812_BIT_HZ * (ws2812_T1 + ws2812_T2 + ws2812_T3));
+
+// ********************************************************************************
+// Pixel map
+//
+// Each range of the vehicle profile shows the level of one led in its
+// colour, 0xRRGGBB at full level.  A led may have several ranges, such as the blinkers at
+// both ends of the strip; pixels outside every range stay dark.
+
+struct PixelRange {
+  enum LedIndex led;
+  uint16_t first;
+  uint16_t count;
+  uint32_t rgb;
+};
+
+#define PIXEL_RANGE_OF_PROFILE(led_, first_, count_, rgb_) \
+  { .led = led_, .first = first_, .count = count_, .rgb = rgb_ },
+
+static const struct PixelRange PIXEL_RANGES[] = {
+  PROFILE_PIXEL_RANGES(PIXEL_RANGE_OF_PROFILE)
+};
+
+#define PIXEL_RANGE_COUNT (sizeof(PIXEL_RANGES) / sizeof(PIXEL_RANGES[0]))
+
+// ********************************************************************************
+// Frames
+//
+// Two frame buffers of one word per pixel, GRB in the top 24 bits as
+// the program shifts them out.  DMA reads the front one while the
+// next frame renders into the back one.  A frame that renders before
+// the strip latched the previous one goes out from an alarm at the
+// end of the reset time, so quick successive renders only drop the
+// frames in between.
+
+static uint32_t ws2812_frames[2][WS2812_PIXEL_COUNT];
+static uint8_t ws2812_back = 0;
+static bool ws2812_queued = false;    // the back buffer holds a frame not sent yet
+static bool ws2812_alarm_armed = false;
+static uint32_t ws2812_sent_us;
+
+static uint ws2812_sm;
+static uint ws2812_dma_chan;
+
+static uint32_t RCLIGHTS_HOT_FUNC(ws2812_pixel)(uint32_t rgb, uint16_t level) {
+  const uint32_t r = ((rgb >> 16) & 0xff) * level / OUTPUT_PWM_MAX_LEVEL;
+  const uint32_t g = ((rgb >> 8) & 0xff) * level / OUTPUT_PWM_MAX_LEVEL;
+  const uint32_t b = (rgb & 0xff) * level / OUTPUT_PWM_MAX_LEVEL;
+
+  return (g << 24) | (r << 16) | (b << 8);
+}
+
+/* Microseconds until the strip has latched the last frame sent. */
+static uint32_t RCLIGHTS_HOT_FUNC(ws2812_busy_us)() {
+  const uint32_t elapsed_us = time_us_32() - ws2812_sent_us;
+
+  return elapsed_us < WS2812_FRAME_US ? WS2812_FRAME_US - elapsed_us : 0;
+}
+
+/* The following function sends the back buffer and swaps the buffers,
+   unless the strip is still receiving or latching a frame. */
+static bool RCLIGHTS_HOT_FUNC(send_ws2812_frame)() {
+  if (ws2812_busy_us()) {
+    return false;
+  }
+
+  dma_channel_transfer_from_buffer_now(ws2812_dma_chan, ws2812_frames[ws2812_back], WS2812_PIXEL_COUNT);
+  ws2812_back ^= 1;
+  ws2812_sent_us = time_us_32();
+  ws2812_queued = false;
+
+  return true;
+}
+
+/* A negative return value reschedules the alarm that many
+   microseconds from now, should it fire early. */
+static int64_t RCLIGHTS_HOT_FUNC(ws2812_alarm_callback)(alarm_id_t id, void* user_data) {
+  if (ws2812_queued && !send_ws2812_frame()) {
+    return -(int64_t)(ws2812_busy_us() + 1);
+  }
+
+  ws2812_alarm_armed = false;
+  return 0;
+}
+
+void init_ws2812() {
+  for (uint i = 0; i < PIXEL_RANGE_COUNT; i++) {
+    assert(PIXEL_RANGES[i].led < LED_COUNT);
+    assert(PIXEL_RANGES[i].first + PIXEL_RANGES[i].count <= WS2812_PIXEL_COUNT);
+  }
+
+  uint offset = pio_add_program(WS2812_PIO, &ws2812_program);
+
+  ws2812_sm = pio_claim_unused_sm(WS2812_PIO, true);
+  ws2812_program_init(WS2812_PIO, ws2812_sm, offset, WS2812_PIN, WS2812_CLK_DIV);
+
+  ws2812_dma_chan = dma_claim_unused_channel(true);
+  ws2812_sent_us = time_us_32() - WS2812_FRAME_US;
+
+  dma_channel_config config = dma_channel_get_default_config(ws2812_dma_chan);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, false);
+  channel_config_set_dreq(&config, pio_get_dreq(WS2812_PIO, ws2812_sm, true));
+  dma_channel_configure(ws2812_dma_chan, &config, &WS2812_PIO->txf[ws2812_sm], ws2812_frames[0], 0, false);
+}
+
+/* Renders run with interrupts disabled, which keeps the alarm from
+   sending while the back buffer is half written. */
+void RCLIGHTS_HOT_FUNC(show_ws2812_levels)(const uint16_t* levels) {
+  uint32_t* frame = ws2812_frames[ws2812_back];
+
+  for (uint p = 0; p < WS2812_PIXEL_COUNT; p++) {
+    frame[p] = 0;
+  }
+
+  for (uint i = 0; i < PIXEL_RANGE_COUNT; i++) {
+    const struct PixelRange* range = &PIXEL_RANGES[i];
+    const uint32_t pixel = ws2812_pixel(range->rgb, levels[range->led]);
+
+    for (uint p = range->first; p < range->first + range->count; p++) {
+      frame[p] = pixel;
+    }
+  }
+
+  ws2812_queued = true;
+
+  if (!send_ws2812_frame() && !ws2812_alarm_armed) {
+    ws2812_alarm_armed = add_alarm_in_us(ws2812_busy_us(), ws2812_alarm_callback, NULL, true) > 0;
+  }
+}
+
+#endif
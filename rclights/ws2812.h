@@ -0,0 +1,36 @@
+// ********************************************************************************
+// WS2812 strip output
+//
+// With RCLIGHTS_WS2812 set to 1, an addressable WS2812 strip shows the
+// leds as well.  A pixel map assigns ranges of pixels to each led,
+// each range with the colour it has at full level, and every render
+// scales those colours by the levels of the leds into a frame buffer.
+// A PIO state machine running the standard WS2812 program sends the
+// frame, fed by a DMA channel, so a long strip costs no CPU per bit.
+// ********************************************************************************
+
+#ifndef RCLIGHTS_WS2812_H
+#define RCLIGHTS_WS2812_H
+
+#include <stdint.h>
+
+#ifndef RCLIGHTS_WS2812
+#define RCLIGHTS_WS2812 0
+#endif
+
+#if RCLIGHTS_WS2812
+
+void init_ws2812();
+
+/* Renders the levels of the rules, one per led, into the next frame
+   and sends it as soon as the strip has latched the previous one. */
+void show_ws2812_levels(const uint16_t* levels);
+
+#else
+
+static inline void init_ws2812() {}
+static inline void show_ws2812_levels(const uint16_t* levels) {}
+
+#endif
+
+#endif